@@ -0,0 +1,163 @@
+// This class models the ADC of a receiver after the noise of the channel:
+// real and imaginary parts of every sample are scaled by the gain of the
+// AGC, quantized to signed integers of a given number of bits and clipped
+// at full scale, as int16 samples of a hardware receiver. The quantizer is
+// mid-rise: code q stands for the middle (q + 1/2) / gain of its step, so
+// there are 2^bits levels symmetric around zero and no level at zero, and
+// the middle decision threshold of the slicer (zero) is a step boundary.
+// Decision thresholds of the slicer are moved into the same integer scale,
+// so qamDemodulator slices integer samples with comparisons only, on
+// packed int16 SIMD lanes (four times as many symbols per instruction as
+// double samples). Integer decisions are the same as double decisions on
+// the dequantized samples, so BER depends only on resolution and clipping;
+// a 2-bit ADC keeps the sign of every axis and QPSK BER as it is.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ADCQUANTIZER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ADCQUANTIZER_H
+
+
+// ADC of the receiver.
+struct AdcParameters {
+    int     bits        = 0;        // Resolution from 2 to 16 bits, 0 means no ADC (double samples).
+    // Clipping level: in RMS of the received signal per axis with AGC,
+    // in units of the constellation grid (outer points are at N-1)
+    // without it. Zero chooses 4 RMS or N.
+    double  fullScale   = 0;
+    // Ideal AGC: gain follows the known power of signal and noise, so the
+    // ADC loads the same way at every SNR.
+    bool    agc         = true;
+};
+
+
+class AdcQuantizer {
+public:
+
+
+    static constexpr int MIN_BITS = 2;
+    static constexpr int MAX_BITS = 16;
+
+
+    void setParameters(const AdcParameters& parameters)
+    {
+        parameters_ = parameters;
+    }
+
+
+    const AdcParameters& getParameters() const
+    {
+        return parameters_;
+    }
+
+
+    bool isEnabled() const
+    {
+        return parameters_.bits != 0;
+    }
+
+
+    /**
+     * Set gain and thresholds for a constellation and a noise level.
+     *
+     * @param nReImValues is a number of values in each axis (sqrt of order).
+     * @param sigma is a noise deviation per axis.
+     */
+    void configure(int nReImValues, double sigma)
+    {
+        double fullScale = parameters_.fullScale;
+        if (parameters_.agc) {
+            // Mean power of N odd integer values per axis is (N^2-1)/3.
+            double rms = std::sqrt( (nReImValues * nReImValues - 1) / 3.0 + sigma * sigma );
+            fullScale  = (fullScale > 0 ? fullScale : 4) * rms;
+        }
+        else if (fullScale <= 0)
+            fullScale = nReImValues;
+        maxCode_ = (1 << (std::clamp( parameters_.bits, MIN_BITS, MAX_BITS ) - 1)) - 1;
+        gain_    = (maxCode_ + 1) / fullScale;
+
+        // Threshold j lies between positions j and j+1 at N-2-2j. A sample
+        // goes to position j+1 or further if its value (q + 1/2) / gain is
+        // not above it, that is if its code q is not above
+        // floor(threshold * gain - 1/2). Thresholds below the lowest code
+        // are never passed and are left out (the rest are above them).
+        thresholds_.clear();
+        for (int j = 0; j < nReImValues - 1; j++) {
+            double threshold = std::floor( (nReImValues - 2 - 2 * j) * gain_ - 0.5 );
+            if (threshold < -maxCode_ - 1)
+                break;
+            thresholds_.push_back( std::int16_t( std::min<double>( threshold, maxCode_ ) ) );
+        }
+    }
+
+
+    /**
+     * Quantize samples into separate arrays of real and imaginary codes.
+     * Code is the floor of the scaled value, from -(maxCode + 1) to maxCode.
+     *
+     * @param samples is a buffer of n received samples.
+     * @param n is a number of samples.
+     * @param re is a buffer of n real codes to write.
+     * @param im is a buffer of n imaginary codes to write.
+     */
+    void quantize(const std::complex<double>* samples, std::size_t n, std::int16_t* re, std::int16_t* im) const
+    {
+        // Array of complex is an array of (real, imag) pairs.
+        const double* values  = reinterpret_cast<const double*>( samples );
+        const double  gain    = gain_;
+        const double  maxCode = maxCode_;
+        const int     offset  = maxCode_ + 1;
+        // Clamped values plus offset are not negative, so truncation is
+        // the floor.
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double x = std::clamp( values[ 2 * i ] * gain, -maxCode - 1, maxCode );
+            double y = std::clamp( values[ 2 * i + 1 ] * gain, -maxCode - 1, maxCode );
+            re[i] = std::int16_t( int( x + offset ) - offset );
+            im[i] = std::int16_t( int( y + offset ) - offset );
+        }
+    }
+
+
+    // Returns decision thresholds of the slicer in codes, descending: at
+    // most N-1, the ones no code passes are left out.
+    const std::vector<std::int16_t>& getThresholds() const
+    {
+        return thresholds_;
+    }
+
+
+    // Returns codes per unit of the constellation grid.
+    double getGain() const
+    {
+        return gain_;
+    }
+
+
+    // Returns the largest code, the smallest one is -(maxCode + 1).
+    int getMaxCode() const
+    {
+        return maxCode_;
+    }
+
+
+
+private:
+
+
+    AdcParameters               parameters_;
+    double                      gain_       = 1;
+    int                         maxCode_    = 1;
+    std::vector<std::int16_t>   thresholds_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ADCQUANTIZER_H
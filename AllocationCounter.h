@@ -0,0 +1,89 @@
+// This header replaces the global operator new and delete of a program
+// with ones which count every allocation: totals of the program (bytes and
+// calls, read by Benchmark) and the Profiler slot of the calling thread
+// (allocations inside trials). Memory comes from malloc, or aligned_alloc
+// for over-aligned types, and every form of delete goes to free. Include
+// it in the one source file of a program which has main, the operators
+// are definitions.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "Profiler.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ALLOCATIONCOUNTER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ALLOCATIONCOUNTER_H
+
+
+class AllocationCounter {
+public:
+
+
+    // Returns bytes allocated by the program so far.
+    static std::uint64_t getBytes()
+    {
+        return bytes_.load( std::memory_order_relaxed );
+    }
+
+
+    // Returns number of allocations of the program so far.
+    static std::uint64_t getNumberOfAllocations()
+    {
+        return allocations_.load( std::memory_order_relaxed );
+    }
+
+
+    /**
+     * Allocate and count memory.
+     *
+     * @param size is a number of bytes.
+     * @param alignment is an alignment, zero for the default one.
+     * @return memory, std::bad_alloc is thrown if there is none.
+     */
+    static void* allocate(std::size_t size, std::size_t alignment)
+    {
+        bytes_.fetch_add( size, std::memory_order_relaxed );
+        allocations_.fetch_add( 1, std::memory_order_relaxed );
+        Profiler::addAllocation( size );
+        size = std::max<std::size_t>( size, 1 );
+        void* p = alignment <= alignof(std::max_align_t) ? std::malloc( size )
+                                                         : std::aligned_alloc( alignment, (size + alignment - 1) / alignment * alignment );
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+
+    // Frees memory of allocate (malloc and aligned_alloc alike).
+    static void deallocate(void* p) noexcept
+    {
+        std::free( p );
+    }
+
+
+
+private:
+
+
+    static inline std::atomic<std::uint64_t> bytes_         = 0;
+    static inline std::atomic<std::uint64_t> allocations_   = 0;
+
+
+
+};
+
+
+void* operator new(std::size_t size)                                { return AllocationCounter::allocate( size, 0 ); }
+void* operator new(std::size_t size, std::align_val_t alignment)    { return AllocationCounter::allocate( size, std::size_t( alignment ) ); }
+void  operator delete(void* p) noexcept                             { AllocationCounter::deallocate( p ); }
+void  operator delete(void* p, std::align_val_t) noexcept           { AllocationCounter::deallocate( p ); }
+// Sized forms go to the plain forms of the same alignment.
+void  operator delete(void* p, std::size_t) noexcept                { ::operator delete( p ); }
+void  operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept { ::operator delete( p, alignment ); }
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ALLOCATIONCOUNTER_H
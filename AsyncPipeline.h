@@ -0,0 +1,317 @@
+// This class transmits data through the chain with every stage on its own
+// thread: bit source, mapper (qamModulator tables), GaussianChannel,
+// slicer (qamDemodulator) and error counter work at the same time on
+// different blocks of symbols. Blocks of a fixed size go from stage to
+// stage through bounded lock-free SpscRing queues and come back to the
+// source through a queue of free blocks, so nothing is allocated while
+// data flows and a slow stage holds back the stages before it. One long
+// payload is processed by all stages at once, which trial-level
+// parallelism of SweepEngine cannot do. Stage threads are started (and
+// pinned) on the first transmission and sleep between transmissions, so
+// trials of a sweep do not create threads. Blocks reach the channel in
+// order and have the size of FusedPipeline chunks, so noise and errors are
+// the same as of FusedPipeline::countErrors for the same seed and stream.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <complex>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Profiler.h"
+#include "SpscRing.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ASYNCPIPELINE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ASYNCPIPELINE_H
+
+
+class AsyncPipeline {
+public:
+
+
+    // Symbols of a block (as FusedPipeline::CHUNK_SYMBOLS).
+    static constexpr std::size_t BLOCK_SYMBOLS  = 2048;
+    // Blocks a queue between two stages holds.
+    static constexpr std::size_t QUEUE_BLOCKS   = 4;
+    // Blocks in flight: enough to fill all queues and stages.
+    static constexpr std::size_t N_BLOCKS       = 4 * QUEUE_BLOCKS + 8;
+    static constexpr int         N_STAGES       = 5;
+
+
+    /**
+     * Create pipeline, blocks and stage threads are allocated on the
+     * first transmission.
+     *
+     * @param firstCore is a core of the first stage thread, stage s is
+     * pinned to core firstCore + s (modulo number of cores). Threads are
+     * not pinned when there are fewer cores than stages.
+     */
+    explicit AsyncPipeline(unsigned firstCore = 0)
+        : firstCore_( firstCore )
+    {
+    }
+
+
+    /**
+     * Transmit data through the channel and count bit errors.
+     *
+     * @param inputData is a data to transmit. Any type with size() (number
+     * of bits) and read(position, nBits) like BitStream, read from the
+     * source thread only.
+     * @param channel is a channel with modulation order, seed and stream
+     * already set. It is used by the channel thread only, its noise
+     * generator advances.
+     * @param SNR is a signal-to-noise ratio value (Eb/N0) in dB.
+     * @return number of wrong bits among inputData.size() bits.
+     */
+    template <typename Source>
+    std::uint64_t countErrors(const Source& inputData, GaussianChannel& channel, double SNR)
+    {
+        const ConstellationTable&           table           = channel.getConstellationTable();
+        int                                 bitsPerSymbol   = table.getBitsPerSymbol();
+        int                                 nReImValues     = table.getNumberOfAxisValues();
+        std::span<const std::complex<int> > pointsOfCodes   = table.getPointsOfCodes();
+        std::span<const int>                GreyCodes       = table.getGreyCodes();
+        std::size_t                         nBits           = inputData.size();
+        std::size_t                         nSymbols        = (nBits + bitsPerSymbol - 1) / bitsPerSymbol;
+
+        if (blocks_.empty()) {
+            blocks_.resize( N_BLOCKS );
+            for (Block& i : blocks_) {
+                i.codes.resize( BLOCK_SYMBOLS );
+                i.samples.resize( BLOCK_SYMBOLS );
+                i.indices.resize( BLOCK_SYMBOLS );
+            }
+        }
+        // Queue q goes from stage q to stage q + 1, the last one brings free
+        // blocks back to the source. A null block ends the transmission.
+        SpscRing<Block*> queues[ Profiler::N_QUEUES ] = {
+            SpscRing<Block*>( QUEUE_BLOCKS ), SpscRing<Block*>( QUEUE_BLOCKS ), SpscRing<Block*>( QUEUE_BLOCKS ),
+            SpscRing<Block*>( QUEUE_BLOCKS ), SpscRing<Block*>( N_BLOCKS )
+        };
+        std::uint64_t errors         = 0;
+        unsigned      lastDifference = 0;
+
+        auto source = [&] {
+            std::size_t nFresh = 0;
+            for (std::size_t begin = 0; begin < nSymbols; begin += BLOCK_SYMBOLS) {
+                Block* block = nFresh < N_BLOCKS ? &blocks_[ nFresh++ ] : queues[ Profiler::COUNT_TO_SOURCE ].pop();
+                block->count = std::min( BLOCK_SYMBOLS, nSymbols - begin );
+                for (std::size_t i = 0; i < block->count; i++)
+                    block->codes[i] = inputData.read( (begin + i) * bitsPerSymbol, bitsPerSymbol );
+                queues[ Profiler::SOURCE_TO_MAP ].push( block );
+            }
+            queues[ Profiler::SOURCE_TO_MAP ].push( nullptr );
+        };
+        auto map = [&] {
+            while (Block* block = queues[ Profiler::SOURCE_TO_MAP ].pop()) {
+                {
+                    Profiler::Scope profile( Profiler::MAP, block->count );
+                    for (std::size_t i = 0; i < block->count; i++) {
+                        std::complex<int> point = pointsOfCodes[ block->codes[i] ];
+                        block->samples[i] = std::complex<double>( point.real(), point.imag() );
+                    }
+                }
+                queues[ Profiler::MAP_TO_NOISE ].push( block );
+            }
+            queues[ Profiler::MAP_TO_NOISE ].push( nullptr );
+        };
+        auto noise = [&] {
+            while (Block* block = queues[ Profiler::MAP_TO_NOISE ].pop()) {
+                channel.addGaussianNoise( block->samples.data(), block->count, SNR );
+                queues[ Profiler::NOISE_TO_DEMAP ].push( block );
+            }
+            queues[ Profiler::NOISE_TO_DEMAP ].push( nullptr );
+        };
+        auto demap = [&] {
+            while (Block* block = queues[ Profiler::NOISE_TO_DEMAP ].pop()) {
+                {
+                    Profiler::Scope profile( Profiler::DEMAP, block->count );
+                    qamDemodulator::sliceData( block->samples.data(), block->count, nReImValues, block->indices.data() );
+                }
+                queues[ Profiler::DEMAP_TO_COUNT ].push( block );
+            }
+            queues[ Profiler::DEMAP_TO_COUNT ].push( nullptr );
+        };
+        auto count = [&] {
+            // Queue of free blocks holds all of them, so this push never waits.
+            while (Block* block = queues[ Profiler::DEMAP_TO_COUNT ].pop()) {
+                {
+                    Profiler::Scope profile( Profiler::COUNT, block->count );
+                    for (std::size_t i = 0; i < block->count; i++) {
+                        unsigned difference = block->codes[i] ^ GreyCodes[ block->indices[i] ];
+                        errors += std::popcount( difference );
+                        lastDifference = difference;
+                    }
+                }
+                queues[ Profiler::COUNT_TO_SOURCE ].push( block );
+            }
+        };
+
+        if (!stageThreads_)
+            stageThreads_ = std::make_unique<StageThreads>( firstCore_ );
+        stageThreads_->run( { source, map, noise, demap, count } );
+
+        for (int q = 0; q < Profiler::N_QUEUES; q++) {
+            SpscRingStatistics s = queues[q].getStatistics();
+            statistics_[q].pushes     += s.pushes;
+            statistics_[q].samples    += s.samples;
+            statistics_[q].occupancy  += s.occupancy;
+            statistics_[q].fullWaits  += s.fullWaits;
+            statistics_[q].emptyWaits += s.emptyWaits;
+            Profiler::addQueueStatistics( Profiler::Queue( q ), queues[q].capacity(), s.pushes, s.samples, s.occupancy,
+                                          s.fullWaits, s.emptyWaits );
+        }
+        // Padding bits of the last symbol were not transmitted.
+        int nPaddingBits = nSymbols * bitsPerSymbol - nBits;
+        return errors - std::popcount( lastDifference & ((1u << nPaddingBits) - 1) );
+    }
+
+
+    /**
+     * Counters of a queue summed over all transmissions. Mean occupancy
+     * (occupancy / samples) near capacity means the stage after the queue
+     * is the bottleneck, near zero means the stage before it is.
+     *
+     * @param queue is a queue.
+     * @return counters of the queue.
+     */
+    const SpscRingStatistics& getStatistics(Profiler::Queue queue) const
+    {
+        return statistics_[ queue ];
+    }
+
+
+
+private:
+
+
+    // Symbols of a block at every stage, stages work on it in place.
+    struct Block {
+        std::size_t                         count = 0;
+        std::vector<unsigned>               codes;
+        std::vector<std::complex<double> >  samples;
+        std::vector<int>                    indices;
+    };
+
+
+    // A thread for every stage. A transmission gives every thread its
+    // stage and waits until all of them return; between transmissions the
+    // threads sleep.
+    class StageThreads {
+    public:
+
+
+        explicit StageThreads(unsigned firstCore)
+        {
+            for (int stage = 0; stage < N_STAGES; stage++) {
+                threads_[ stage ] = std::thread( &StageThreads::serve, this, stage );
+                pin( threads_[ stage ], firstCore, stage );
+            }
+        }
+
+
+        ~StageThreads()
+        {
+            {
+                std::lock_guard<std::mutex> lock( mutex_ );
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (std::thread& i : threads_)
+                i.join();
+        }
+
+
+        // Runs stage s on thread s, returns when all stages are finished.
+        void run(std::array<std::function<void()>, N_STAGES> stages)
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+            stages_   = std::move( stages );
+            nRunning_ = N_STAGES;
+            generation_++;
+            wake_.notify_all();
+            finished_.wait( lock, [this] { return nRunning_ == 0; } );
+        }
+
+
+
+    private:
+
+
+        void serve(int stage)
+        {
+            std::uint64_t generation = 0;
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock( mutex_ );
+                    wake_.wait( lock, [&] { return stopping_ || generation_ != generation; } );
+                    if (stopping_)
+                        return;
+                    generation = generation_;
+                    task       = std::move( stages_[ stage ] );
+                }
+                task();
+                std::lock_guard<std::mutex> lock( mutex_ );
+                if (--nRunning_ == 0)
+                    finished_.notify_one();
+            }
+        }
+
+
+        // Pins a stage thread to its core if there is a core for every stage.
+        static void pin(std::thread& thread, unsigned firstCore, int stage)
+        {
+#if defined(__linux__)
+            unsigned nCores = std::thread::hardware_concurrency();
+            if (nCores < N_STAGES)
+                return;
+            cpu_set_t cores;
+            CPU_ZERO( &cores );
+            CPU_SET( (firstCore + stage) % nCores, &cores );
+            pthread_setaffinity_np( thread.native_handle(), sizeof(cores), &cores );
+#endif
+        }
+
+
+
+        std::thread                                 threads_[ N_STAGES ];
+        std::mutex                                  mutex_;
+        std::condition_variable                     wake_;
+        std::condition_variable                     finished_;
+        std::array<std::function<void()>, N_STAGES> stages_;
+        std::uint64_t                               generation_ = 0;
+        int                                         nRunning_   = 0;
+        bool                                        stopping_   = false;
+
+
+
+    };
+
+
+
+    unsigned                            firstCore_;
+    std::vector<Block>                  blocks_;
+    SpscRingStatistics                  statistics_[ Profiler::N_QUEUES ];
+    std::unique_ptr<StageThreads>       stageThreads_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_ASYNCPIPELINE_H
@@ -0,0 +1,395 @@
+// Microbenchmarks of the chain: every stage alone (modulateData,
+// addGaussianNoise, addFadingNoise, demodulateData, computeBER, soft
+// demodulation, Viterbi decoding, float mapping with noise and slicing,
+// 8-bit ADC quantization and int16 slicing), the whole staged and fused
+// chain of one trial (also with Rayleigh fading, in single precision and
+// with the ADC, and the staged chain on caller's buffers of an arena,
+// which allocates nothing), the chain with a thread per stage, the
+// parallel sweep, and RRC filters (FFT overlap-save against direct form).
+// Each benchmark is repeated after warmup runs over a grid of modulation
+// orders, payload sizes and thread counts. Results go to CSV or JSON with
+// one line per measurement, so throughput of two builds can be compared.
+//
+// Options: --orders=4,16,64,256,1024 --symbols=4096,65536,1048576
+// --threads=1,2,4 (sweep only, default is powers of two up to the number
+// of cores) --sweep-trials=16 --warmup=1 --repetitions=5 --snr=6
+// --filter-spans=8,16,32,64 (RRC span in symbols) --format=csv|json
+// --output=PATH (default is standard output).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "QAMmodulator.h"
+#include "QAMdemodulator.h"
+#include "GaussianChannel.h"
+#include "Instruments.h"
+#include "ConvolutionalCode.h"
+#include "AdcQuantizer.h"
+#include "AllocationCounter.h"
+#include "AsyncPipeline.h"
+#include "BufferArena.h"
+#include "PayloadSource.h"
+#include "PulseShaper.h"
+#include "SweepEngine.h"
+
+
+// Keeps results of benchmarks alive, so the compiler cannot drop the work.
+static volatile double sink = 0;
+
+
+// Makes the compiler assume that memory of data is read, so stores into
+// a result which is not used otherwise are not removed.
+template <typename T>
+static void keep(const T& data)
+{
+#if defined(__GNUC__)
+    asm volatile( "" : : "r"( data.data() ) : "memory" );
+#else
+    sink = sink + double( data.size() );
+#endif
+}
+
+
+// Timings of one benchmark at one grid point.
+struct Measurement {
+    std::string         benchmark;
+    int                 modulationOrder = 0;
+    std::size_t         nPayloadSymbols = 0;    // Symbols of one trial.
+    std::size_t         nSymbols        = 0;    // Symbols processed by one run.
+    unsigned            nThreads        = 1;
+    std::vector<double> times;                  // Nanoseconds of every timed run.
+    double              bytes           = 0;    // Allocated by one run.
+    double              allocations     = 0;
+};
+
+
+/**
+ * Run a function warmup times untimed, then repetitions times timed.
+ *
+ * @param body is a function to measure, one run per call.
+ * @param warmup is a number of untimed runs.
+ * @param repetitions is a number of timed runs.
+ * @param result is a measurement to fill times and allocations of.
+ */
+static void measure(const std::function<void()>& body, int warmup, int repetitions, Measurement& result)
+{
+    for (int i = 0; i < warmup; i++)
+        body();
+    result.times.reserve( repetitions );
+    std::uint64_t bytesBefore       = AllocationCounter::getBytes();
+    std::uint64_t allocationsBefore = AllocationCounter::getNumberOfAllocations();
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto stop  = std::chrono::steady_clock::now();
+        result.times.push_back( std::chrono::duration<double, std::nano>( stop - start ).count() );
+    }
+    result.bytes       = double( AllocationCounter::getBytes() - bytesBefore ) / repetitions;
+    result.allocations = double( AllocationCounter::getNumberOfAllocations() - allocationsBefore ) / repetitions;
+}
+
+
+// Statistics of timed runs.
+struct Statistics {
+    double median = 0, min = 0, mean = 0, deviation = 0;
+};
+
+
+static Statistics computeStatistics(std::vector<double> times)
+{
+    Statistics s;
+    if (times.empty())
+        return s;
+    std::sort( times.begin(), times.end() );
+    std::size_t n = times.size();
+    s.median = n % 2 ? times[ n / 2 ] : (times[ n / 2 - 1 ] + times[ n / 2 ]) / 2;
+    s.min    = times.front();
+    for (double t : times)
+        s.mean += t / n;
+    for (double t : times)
+        s.deviation += (t - s.mean) * (t - s.mean);
+    s.deviation = n > 1 ? std::sqrt( s.deviation / (n - 1) ) : 0;
+    return s;
+}
+
+
+// Splits "4,16,64" into numbers.
+static std::vector<std::uint64_t> parseList(const std::string& text)
+{
+    std::vector<std::uint64_t> values;
+    std::stringstream stream( text );
+    std::string item;
+    while (std::getline( stream, item, ',' ))
+        if (!item.empty())
+            values.push_back( std::stoull( item ) );
+    return values;
+}
+
+
+static void writeResults(std::ostream& out, const std::vector<Measurement>& results, bool json)
+{
+    if (json)
+        out << "[" << std::endl;
+    else
+        out << "benchmark,order,payload_symbols,symbols,threads,repetitions,median_ns,min_ns,mean_ns,stddev_ns,"
+               "ns_per_symbol,Msym_per_s,bytes_per_run,allocations_per_run" << std::endl;
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        Statistics s = computeStatistics( m.times );
+        double nsPerSymbol = s.median / m.nSymbols;
+        double Msps        = 1e3 / nsPerSymbol;
+        if (json)
+            out << "  {\"benchmark\": \"" << m.benchmark << "\", \"order\": " << m.modulationOrder
+                << ", \"payload_symbols\": " << m.nPayloadSymbols << ", \"symbols\": " << m.nSymbols << ", \"threads\": " << m.nThreads
+                << ", \"repetitions\": " << m.times.size() << ", \"median_ns\": " << s.median
+                << ", \"min_ns\": " << s.min << ", \"mean_ns\": " << s.mean << ", \"stddev_ns\": " << s.deviation
+                << ", \"ns_per_symbol\": " << nsPerSymbol << ", \"Msym_per_s\": " << Msps
+                << ", \"bytes_per_run\": " << m.bytes << ", \"allocations_per_run\": " << m.allocations << "}"
+                << (i + 1 < results.size() ? "," : "") << std::endl;
+        else
+            out << m.benchmark << ',' << m.modulationOrder << ',' << m.nPayloadSymbols << ',' << m.nSymbols << ',' << m.nThreads << ','
+                << m.times.size() << ',' << s.median << ',' << s.min << ',' << s.mean << ',' << s.deviation << ','
+                << nsPerSymbol << ',' << Msps << ',' << m.bytes << ',' << m.allocations << std::endl;
+    }
+    if (json)
+        out << "]" << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+    Instruments InstrumentsObj;
+    std::map<std::string, std::string> options = InstrumentsObj.parseArguments( argc, argv );
+    auto option = [&](const std::string& name, const std::string& defaultValue) {
+        return options.count( name ) ? options[ name ] : defaultValue;
+    };
+
+    std::string defaultThreads = "1";
+    for (unsigned i = 2; i <= std::thread::hardware_concurrency(); i *= 2)
+        defaultThreads += "," + std::to_string( i );
+    std::vector<std::uint64_t> orders      = parseList( option( "orders", "4,16,64,256,1024" ) );
+    std::vector<std::uint64_t> sizes       = parseList( option( "symbols", "4096,65536,1048576" ) );
+    std::vector<std::uint64_t> threads     = parseList( option( "threads", defaultThreads ) );
+    int                        sweepTrials = std::stoi( option( "sweep-trials", "16" ) );
+    int                        warmup      = std::stoi( option( "warmup", "1" ) );
+    int                        repetitions = std::max( std::stoi( option( "repetitions", "5" ) ), 1 );
+    double                     SNR         = std::stod( option( "snr", "6" ) );
+    bool                       json        = option( "format", "csv" ) == "json";
+
+    std::vector<Measurement> results;
+    for (std::uint64_t order : orders) {
+        int modulationOrder = order;
+        qamModulator    QAMmodulatorObj;
+        qamDemodulator  QAMdemodulatorObj;
+        GaussianChannel GaussianChannelObj;
+        GaussianChannel FadingChannelObj;
+        FusedPipeline   FusedPipelineObj;
+        AsyncPipeline   AsyncPipelineObj;
+        ConvolutionalCode ViterbiObj;
+        BufferArena     BufferArenaObj;
+        AdcQuantizer    AdcQuantizerObj;
+        BitStream       bitsDemodulated;
+        AdcParameters   adc;
+        adc.bits = 8;
+        AdcQuantizerObj.setParameters( adc );
+        FadingParameters fading;
+        fading.model = FadingParameters::RAYLEIGH;
+        FadingChannelObj.setFading( fading );
+        QAMmodulatorObj.setModulationOrder( modulationOrder );
+        QAMdemodulatorObj.setModulationOrder( modulationOrder );
+        GaussianChannelObj.setModulationOrder( modulationOrder );
+        FadingChannelObj.setModulationOrder( modulationOrder );
+        modulationOrder = QAMmodulatorObj.getModulationOrder();
+        int bitsPerSymbol = QAMmodulatorObj.getConstellationTable().getBitsPerSymbol();
+
+        for (std::uint64_t nSymbols : sizes) {
+            // Same payload and noise in every run.
+            BitStream data = PayloadSource::random( nSymbols * bitsPerSymbol, 1 ).toBitStream();
+            std::vector<std::complex<int> >     dataModulated   = QAMmodulatorObj.modulateData( data );
+            std::vector<std::complex<double> >  dataDouble;
+            for (std::complex<int> i : dataModulated)
+                dataDouble.push_back( std::complex<double>( i.real(), i.imag() ) );
+            GaussianChannelObj.setSeed( 1 );
+            std::vector<std::complex<double> >  dataNoised      = GaussianChannelObj.addGaussianNoise( dataDouble, SNR );
+            BitStream                           dataDemodulated = QAMdemodulatorObj.demodulateData( dataNoised, modulationOrder );
+            std::vector<float>                  LLRs( nSymbols * bitsPerSymbol );
+            double                              noiseDeviation  = GaussianChannelObj.getNoiseDeviation( SNR );
+            std::vector<double>                 re( nSymbols );
+            std::vector<double>                 im( nSymbols );
+            std::vector<unsigned>               codes( nSymbols );
+            std::vector<float>                  floatRe( nSymbols );
+            std::vector<float>                  floatIm( nSymbols );
+            std::vector<int>                    indices( nSymbols );
+            std::vector<std::int16_t>           codeRe( nSymbols );
+            std::vector<std::int16_t>           codeIm( nSymbols );
+            std::vector<std::int16_t>           shortIndices( nSymbols );
+            AdcQuantizerObj.configure( QAMmodulatorObj.getConstellationTable().getNumberOfAxisValues(), noiseDeviation );
+            AdcQuantizerObj.quantize( dataNoised.data(), nSymbols, codeRe.data(), codeIm.data() );
+
+            std::vector<std::pair<std::string, std::function<void()> > > stages = {
+                { "modulate", [&] { keep( QAMmodulatorObj.modulateData( data ) ); } },
+                { "noise",    [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    keep( GaussianChannelObj.addGaussianNoise( dataDouble, SNR ) );
+                } },
+                { "fading",   [&] {
+                    // Rayleigh gain per symbol, noise and zero forcing on SoA buffers.
+                    for (std::size_t i = 0; i < nSymbols; i++) {
+                        re[i] = dataModulated[i].real();
+                        im[i] = dataModulated[i].imag();
+                    }
+                    FadingChannelObj.setSeed( 1 );
+                    FadingChannelObj.addFadingNoise( re.data(), im.data(), nSymbols, SNR, 0 );
+                    keep( re );
+                } },
+                { "noise_float", [&] {
+                    // Mapper output and noise on float SoA buffers.
+                    qamModulator::mapData( data, 0, nSymbols, QAMmodulatorObj.getConstellationTable(), codes.data(),
+                                           floatRe.data(), floatIm.data() );
+                    GaussianChannelObj.setSeed( 1 );
+                    GaussianChannelObj.addGaussianNoise( floatRe.data(), floatIm.data(), nSymbols, SNR );
+                    keep( floatRe );
+                } },
+                { "demap",    [&] { keep( QAMdemodulatorObj.demodulateData( dataNoised, modulationOrder ).words() ); } },
+                { "demap_float", [&] {
+                    qamDemodulator::sliceData( floatRe.data(), floatIm.data(), nSymbols,
+                                               QAMdemodulatorObj.getConstellationTable().getNumberOfAxisValues(), indices.data() );
+                    keep( indices );
+                } },
+                { "quantize", [&] {
+                    AdcQuantizerObj.quantize( dataNoised.data(), nSymbols, codeRe.data(), codeIm.data() );
+                    keep( codeRe );
+                } },
+                { "demap_int16", [&] {
+                    qamDemodulator::sliceData( codeRe.data(), codeIm.data(), nSymbols,
+                                               QAMdemodulatorObj.getConstellationTable().getNumberOfAxisValues(),
+                                               AdcQuantizerObj.getThresholds(), shortIndices.data() );
+                    keep( shortIndices );
+                } },
+                { "ber",      [&] { sink = sink + InstrumentsObj.computeBER( data, dataDemodulated ); } },
+                { "soft",     [&] {
+                    QAMdemodulatorObj.demodulateData( dataNoised, noiseDeviation, LLRs );
+                    keep( LLRs );
+                } },
+                { "viterbi",  [&] {
+                    // LLRs of a symbol are log2(order)/2 decoded bits.
+                    keep( ViterbiObj.decode( std::span<const float>( LLRs ) ).words() );
+                } },
+                { "chain",    [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    std::vector<std::complex<double> > noised = GaussianChannelObj.addGaussianNoise( QAMmodulatorObj.modulateData( data ), SNR );
+                    sink = sink + InstrumentsObj.computeBER( data, QAMdemodulatorObj.demodulateData( noised, modulationOrder ) );
+                } },
+                { "chain_buffers", [&] {
+                    std::span<std::complex<int> >    modulated = BufferArenaObj.allocate<std::complex<int> >( nSymbols );
+                    std::span<std::complex<double> > noised    = BufferArenaObj.allocate<std::complex<double> >( nSymbols );
+                    QAMmodulatorObj.modulateData( data, modulated );
+                    GaussianChannelObj.setSeed( 1 );
+                    GaussianChannelObj.addGaussianNoise( std::span<const std::complex<int> >( modulated ), SNR, noised );
+                    QAMdemodulatorObj.demodulateData( noised, modulationOrder, BufferArenaObj.allocate<int>( nSymbols ), bitsDemodulated );
+                    sink = sink + InstrumentsObj.computeBER( data, bitsDemodulated );
+                    // The warmup run leaves a block large enough for all the others.
+                    BufferArenaObj.reset();
+                } },
+                { "fused",    [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    sink = sink + FusedPipelineObj.countErrors( data, GaussianChannelObj, SNR );
+                } },
+                { "fused_float", [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    FusedPipelineObj.setPrecision( FusedPipeline::SINGLE );
+                    sink = sink + FusedPipelineObj.countErrors( data, GaussianChannelObj, SNR );
+                    FusedPipelineObj.setPrecision( FusedPipeline::DOUBLE );
+                } },
+                { "fused_adc", [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    FusedPipelineObj.setAdc( adc );
+                    sink = sink + FusedPipelineObj.countErrors( data, GaussianChannelObj, SNR );
+                    FusedPipelineObj.setAdc( AdcParameters() );
+                } },
+                { "pipelined", [&] {
+                    GaussianChannelObj.setSeed( 1 );
+                    sink = sink + AsyncPipelineObj.countErrors( data, GaussianChannelObj, SNR );
+                } },
+                { "fused_fading", [&] {
+                    FadingChannelObj.setSeed( 1 );
+                    sink = sink + FusedPipelineObj.countErrors( data, FadingChannelObj, SNR );
+                } },
+            };
+            for (auto& [name, body] : stages) {
+                Measurement m;
+                m.benchmark       = name;
+                m.modulationOrder = modulationOrder;
+                m.nPayloadSymbols = nSymbols;
+                m.nSymbols        = nSymbols;
+                measure( body, warmup, repetitions, m );
+                results.push_back( m );
+            }
+
+            // Whole sweep of one point, fixed number of trials.
+            for (std::uint64_t nThreads : threads) {
+                SweepEngine     SweepEngineObj( nThreads );
+                SweepParameters parameters;
+                parameters.SNR              = { SNR };
+                parameters.modulationOrders = { modulationOrder };
+                parameters.nExperiments     = sweepTrials;
+                Measurement m;
+                m.benchmark       = "sweep";
+                m.modulationOrder = modulationOrder;
+                m.nPayloadSymbols = nSymbols;
+                m.nSymbols        = nSymbols * sweepTrials;
+                m.nThreads        = SweepEngineObj.getNumberOfThreads();
+                measure( [&] { sink = sink + SweepEngineObj.run( parameters, data )[0].BER; }, warmup, repetitions, m );
+                results.push_back( m );
+            }
+        }
+    }
+
+    // RRC filters at 8 samples per symbol: FFT overlap-save against direct
+    // form, n symbols are 8n samples. Name has the number of taps.
+    for (std::uint64_t span : parseList( option( "filter-spans", "8,16,32,64" ) ))
+        for (std::uint64_t nSymbols : sizes) {
+            std::vector<double>                 taps = PulseShaper::rootRaisedCosine( 0.25, span, 8 );
+            OverlapSaveFilter                   filter( taps );
+            std::vector<std::complex<double> >  input( 8 * nSymbols, std::complex<double>( 1, -1 ) );
+            std::vector<std::complex<double> >  output( input.size() );
+            for (bool direct : { false, true }) {
+                Measurement m;
+                m.benchmark       = (direct ? "fir_direct_" : "fir_fft_") + std::to_string( taps.size() );
+                m.nPayloadSymbols = nSymbols;
+                m.nSymbols        = nSymbols;
+                measure( [&] {
+                    filter.reset();
+                    if (direct)
+                        filter.processDirect( input.data(), input.size(), output.data() );
+                    else
+                        filter.process( input.data(), input.size(), output.data() );
+                    keep( output );
+                }, warmup, repetitions, m );
+                results.push_back( m );
+            }
+        }
+
+    if (options.count( "output" )) {
+        std::ofstream out( options["output"] );
+        if (!out.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return 1;
+        }
+        writeResults( out, results, json );
+    }
+    else
+        writeResults( std::cout, results, json );
+    return 0;
+}
@@ -0,0 +1,141 @@
+// This class stores a sequence of bits packed into 64-bit words. Bits
+// go from MSB to LSB inside a word, so a group of consecutive bits of the
+// stream reads as an ordinary binary number. Unused bits of the last
+// word are always zero.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BITSTREAM_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BITSTREAM_H
+
+
+class BitStream {
+public:
+
+
+    // Returns number of bits.
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+
+    // Returns packed words. Bit i is bit (63 - i % 64) of word i / 64.
+    const std::vector<std::uint64_t>& words() const
+    {
+        return words_;
+    }
+
+
+    // Reserves memory for a given number of bits.
+    void reserve(std::size_t nBits)
+    {
+        words_.reserve( (nBits + 63) / 64 );
+    }
+
+
+    void clear()
+    {
+        words_.clear();
+        size_ = 0;
+    }
+
+
+    // Returns bit with a given index.
+    bool operator[](std::size_t index) const
+    {
+        return words_[ index / 64 ] >> (63 - index % 64) & 1;
+    }
+
+
+    /**
+     * Append nBits lowest bits of value, from MSB to LSB.
+     *
+     * @param value is a number to append, must be lower than 2^nBits.
+     * @param nBits is a number of bits, from 0 to 64.
+     */
+    void append(std::uint64_t value, int nBits)
+    {
+        if (nBits == 0)
+            return;
+        int offset = size_ % 64;
+        if (offset == 0)
+            words_.push_back( 0 );
+        int free = 64 - offset;
+        if (nBits <= free) {
+            words_.back() |= value << (free - nBits);
+        }
+        else {
+            words_.back() |= value >> (nBits - free);
+            words_.push_back( value << (64 - (nBits - free)) );
+        }
+        size_ += nBits;
+    }
+
+
+    /**
+     * Read nBits bits starting from a given position as a number.
+     * Bits beyond the end of the stream read as zeros.
+     *
+     * @param position is an index of the first (most significant) bit.
+     * @param nBits is a number of bits, from 1 to 64.
+     * @return bits as a number.
+     */
+    std::uint64_t read(std::size_t position, int nBits) const
+    {
+        std::size_t word   = position / 64;
+        int         offset = position % 64;
+        std::uint64_t bits = word < words_.size() ? words_[ word ] << offset : 0;
+        if (offset + nBits > 64 && word + 1 < words_.size())
+            bits |= words_[ word + 1 ] >> (64 - offset);
+        return bits >> (64 - nBits);
+    }
+
+
+    /**
+     * Count positions where two streams differ (XOR and popcount
+     * of whole words).
+     *
+     * @param other is a stream to compare with.
+     * @param nBits is a number of first bits to compare. Bits missing
+     * in one of the streams count as differences.
+     * @return number of different bits.
+     */
+    std::uint64_t countDifferences(const BitStream& other, std::size_t nBits) const
+    {
+        std::size_t common = std::min( { nBits, size_, other.size_ } );
+        std::size_t nWords = common / 64;
+        std::uint64_t count = 0;
+        for (std::size_t i = 0; i < nWords; i++)
+            count += std::popcount( words_[i] ^ other.words_[i] );
+        if (common % 64 != 0) {
+            std::uint64_t mask = ~std::uint64_t( 0 ) << (64 - common % 64);
+            count += std::popcount( (words_[ nWords ] ^ other.words_[ nWords ]) & mask );
+        }
+        return count + (nBits - common);
+    }
+
+
+
+private:
+
+
+    std::vector<std::uint64_t>  words_;
+    std::size_t                 size_ = 0;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BITSTREAM_H
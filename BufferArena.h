@@ -0,0 +1,111 @@
+// This class hands out 64-byte aligned buffers of a trial from one block
+// of memory and takes all of them back at once. A worker resets its arena
+// at the start of every trial, so buffers of the staged chain take the
+// same memory trial after trial. A trial which needs more memory than the
+// block gets extra blocks; the next reset replaces all of them by one
+// block of the size the trial needed, so after the largest trial the
+// arena does not allocate any more.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BUFFERARENA_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BUFFERARENA_H
+
+
+class BufferArena {
+public:
+
+
+    static constexpr std::size_t ALIGNMENT = 64;
+
+
+    /**
+     * Take a buffer which stays valid until the next reset. Values are
+     * not initialized.
+     *
+     * @param n is a number of elements.
+     * @return buffer of n elements.
+     */
+    template <typename T>
+    std::span<T> allocate(std::size_t n)
+    {
+        static_assert( std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>
+                       && alignof(T) <= ALIGNMENT );
+        std::size_t bytes = (n * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        used_ += bytes;
+        if (used_ <= capacity_)
+            return std::span<T>( reinterpret_cast<T*>( block_.get() + used_ - bytes ), n );
+        // Block is full: memory of its own until the next reset.
+        extra_.push_back( allocateBlock( bytes ) );
+        return std::span<T>( reinterpret_cast<T*>( extra_.back().get() ), n );
+    }
+
+
+    // Takes back all buffers. Grows the block if the last trial did not fit.
+    void reset()
+    {
+        if (used_ > capacity_) {
+            extra_.clear();
+            block_    = allocateBlock( used_ );
+            capacity_ = used_;
+            growths_++;
+        }
+        used_ = 0;
+    }
+
+
+    // Returns size of the block in bytes.
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+
+    // Returns number of times the block was replaced by a larger one.
+    std::uint64_t getNumberOfGrowths() const
+    {
+        return growths_;
+    }
+
+
+
+private:
+
+
+    struct Deleter {
+        void operator()(std::byte* p) const
+        {
+            ::operator delete( p, std::align_val_t( ALIGNMENT ) );
+        }
+    };
+
+
+    using Block = std::unique_ptr<std::byte[], Deleter>;
+
+
+    static Block allocateBlock(std::size_t bytes)
+    {
+        return Block( static_cast<std::byte*>( ::operator new( bytes, std::align_val_t( ALIGNMENT ) ) ) );
+    }
+
+
+
+    Block               block_;
+    std::size_t         capacity_   = 0;
+    std::size_t         used_       = 0;
+    std::vector<Block>  extra_;
+    std::uint64_t       growths_    = 0;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_BUFFERARENA_H
@@ -0,0 +1,183 @@
+// This class holds immutable lookup tables of a square QAM constellation:
+// points in the order of createComplexValuesConstellation, Grey code of
+// every point and the inverse (point of every code). Tables of all
+// supported orders (4 ... 4096) are generated at compile time and shared
+// by qamModulator, qamDemodulator and GaussianChannel.
+
+#include <array>
+#include <bit>
+#include <complex>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONSTELLATIONTABLE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONSTELLATIONTABLE_H
+
+
+class ConstellationTable {
+public:
+
+
+    static constexpr int MIN_ORDER = 4;
+    static constexpr int MAX_ORDER = 4096;
+
+
+    // Returns true if order is a power of four from MIN_ORDER to MAX_ORDER.
+    static constexpr bool isSupported(int modulationOrder)
+    {
+        for (int i = MIN_ORDER; i <= MAX_ORDER; i *= 4)
+            if (modulationOrder == i)
+                return true;
+        return false;
+    }
+
+
+    /**
+     * Get tables of a given order.
+     *
+     * @param modulationOrder must be supported (see isSupported).
+     * @return tables which live until the end of the program.
+     */
+    static const ConstellationTable& forOrder(int modulationOrder)
+    {
+        switch (modulationOrder) {
+            case 4:     return view<4>();
+            case 16:    return view<16>();
+            case 64:    return view<64>();
+            case 256:   return view<256>();
+            case 1024:  return view<1024>();
+            case 4096:  return view<4096>();
+            default:    throw std::invalid_argument( "Unsupported modulation order " + std::to_string( modulationOrder ) );
+        }
+    }
+
+
+    int getModulationOrder() const
+    {
+        return modulationOrder_;
+    }
+
+
+    int getBitsPerSymbol() const
+    {
+        return bitsPerSymbol_;
+    }
+
+
+    // Returns number of values in each axis (square root of order).
+    int getNumberOfAxisValues() const
+    {
+        return nReImValues_;
+    }
+
+
+    // Returns constellation points. Point i has Grey code greyCodes[i].
+    std::span<const std::complex<int> > getPoints() const
+    {
+        return points_;
+    }
+
+
+    // Returns Grey code (transmitted bits) of every point.
+    std::span<const int> getGreyCodes() const
+    {
+        return greyCodes_;
+    }
+
+
+    // Returns index of the point for every code (inverse of getGreyCodes).
+    std::span<const int> getIndicesOfCodes() const
+    {
+        return indicesOfCodes_;
+    }
+
+
+    // Returns point for every code, so mapping is a single load.
+    std::span<const std::complex<int> > getPointsOfCodes() const
+    {
+        return pointsOfCodes_;
+    }
+
+
+
+private:
+
+
+    template <int M>
+    struct Arrays {
+        std::array<std::complex<int>, M>    points;
+        std::array<int, M>                  greyCodes;
+        std::array<int, M>                  indicesOfCodes;
+        std::array<std::complex<int>, M>    pointsOfCodes;
+    };
+
+
+    // Same values as createComplexValuesConstellation and createGreyCodes.
+    template <int M>
+    static constexpr Arrays<M> makeArrays()
+    {
+        Arrays<M> arrays{};
+        int nReImValues = 2;
+        while (nReImValues * nReImValues < M)
+            nReImValues *= 2;
+        for (int i = 0; i < M; i++) {
+            // Axis values go from nReImValues-1 down to -(nReImValues-1) by 2,
+            // imaginary part changes slower.
+            int re = nReImValues - 1 - 2 * (i % nReImValues);
+            int im = nReImValues - 1 - 2 * (i / nReImValues);
+            arrays.points[i]    = std::complex<int>( re, im );
+            arrays.greyCodes[i] = i ^ (i >> 1);
+        }
+        for (int i = 0; i < M; i++) {
+            arrays.indicesOfCodes[ arrays.greyCodes[i] ] = i;
+            arrays.pointsOfCodes[ arrays.greyCodes[i] ]  = arrays.points[i];
+        }
+        return arrays;
+    }
+
+
+    template <int M>
+    static constexpr Arrays<M> ARRAYS = makeArrays<M>();
+
+
+    template <int M>
+    static const ConstellationTable& view()
+    {
+        static const ConstellationTable table( M, ARRAYS<M>.points, ARRAYS<M>.greyCodes,
+                                               ARRAYS<M>.indicesOfCodes, ARRAYS<M>.pointsOfCodes );
+        return table;
+    }
+
+
+    ConstellationTable(int                                  modulationOrder,
+                       std::span<const std::complex<int> >  points,
+                       std::span<const int>                 greyCodes,
+                       std::span<const int>                 indicesOfCodes,
+                       std::span<const std::complex<int> >  pointsOfCodes)
+        : modulationOrder_( modulationOrder ),
+          bitsPerSymbol_( std::countr_zero( unsigned( modulationOrder ) ) ),
+          nReImValues_( 1 << (bitsPerSymbol_ / 2) ),
+          points_( points ),
+          greyCodes_( greyCodes ),
+          indicesOfCodes_( indicesOfCodes ),
+          pointsOfCodes_( pointsOfCodes )
+    {
+    }
+
+
+
+    int                                 modulationOrder_;
+    int                                 bitsPerSymbol_;
+    int                                 nReImValues_;
+    std::span<const std::complex<int> > points_;
+    std::span<const int>                greyCodes_;
+    std::span<const int>                indicesOfCodes_;
+    std::span<const std::complex<int> > pointsOfCodes_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONSTELLATIONTABLE_H
@@ -0,0 +1,282 @@
+// This class is the rate 1/2 convolutional code with constraint length 7
+// and generators 133, 171 (octal), as in IEEE 802.11 and CCSDS. Encoder
+// ends data with 6 zero tail bits, so the trellis ends in the zero state.
+// Viterbi decoder takes soft (LLR) or hard input. Add-compare-select of
+// the 64 states of a step is one branch-free loop over butterflies, which
+// the compiler runs in SIMD lanes, and decisions of the last steps are
+// kept in a small ring: every WINDOW steps the survivor of the best state
+// is traced back through DEPTH more steps and WINDOW bits are output, so
+// memory does not depend on the length of data.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "BitStream.h"
+#include "Profiler.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONVOLUTIONALCODE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONVOLUTIONALCODE_H
+
+
+class ConvolutionalCode {
+public:
+
+
+    // Input of the decoder.
+    enum Decision {
+        NONE,   // Uncoded transmission.
+        HARD,   // Bits of qamDemodulator::demodulateData.
+        SOFT    // Max-log LLRs of qamDemodulator::demodulateData.
+    };
+
+
+    static constexpr int        CONSTRAINT_LENGTH   = 7;
+    static constexpr int        N_STATES            = 1 << (CONSTRAINT_LENGTH - 1);
+    static constexpr int        N_TAIL_BITS         = CONSTRAINT_LENGTH - 1;
+    static constexpr unsigned   GENERATORS[2]       = { 0133, 0171 };
+    static constexpr double     RATE                = 0.5;
+
+
+    /**
+     * Convert decision name ("none", "hard" or "soft") to decision.
+     *
+     * @param name is a name of the decision.
+     * @return decision.
+     * @throws std::invalid_argument if name is unknown.
+     */
+    static Decision parseDecision(const std::string& name)
+    {
+        if (name == "hard")
+            return HARD;
+        if (name == "soft")
+            return SOFT;
+        if (name != "none")
+            throw std::invalid_argument( "Unknown code decision " + name + ", it must be none, hard or soft" );
+        return NONE;
+    }
+
+
+    // Returns number of coded bits of nBits data bits.
+    static std::size_t getCodedSize(std::size_t nBits)
+    {
+        return 2 * (nBits + N_TAIL_BITS);
+    }
+
+
+    /**
+     * Encode data.
+     *
+     * @param inputData is a data to encode. Any type with size() (number
+     * of bits) and read(position, nBits) like BitStream.
+     * @return 2 coded bits per data bit and per tail bit.
+     */
+    template <typename Source>
+    static BitStream encode(const Source& inputData)
+    {
+        BitStream output;
+        output.reserve( getCodedSize( inputData.size() ) );
+        unsigned state = 0;
+        for (std::size_t position = 0; position < inputData.size() + N_TAIL_BITS; position += 32) {
+            // 32 data bits give one 64-bit word of coded bits.
+            int           nBits = std::min<std::size_t>( 32, inputData.size() + N_TAIL_BITS - position );
+            // Bits beyond the end read as zeros, they are the tail.
+            std::uint64_t bits  = position < inputData.size() ? inputData.read( position, 32 ) : 0;
+            std::uint64_t coded = 0;
+            for (int i = 0; i < nBits; i++) {
+                unsigned shiftRegister = unsigned( bits >> (31 - i) & 1 ) << (CONSTRAINT_LENGTH - 1) | state;
+                coded = coded << 2 | parity( shiftRegister & GENERATORS[0] ) << 1 | parity( shiftRegister & GENERATORS[1] );
+                state = shiftRegister >> 1;
+            }
+            output.append( coded, 2 * nBits );
+        }
+        return output;
+    }
+
+
+    /**
+     * Decode soft input.
+     *
+     * @param LLRs is getCodedSize(nBits) LLRs ln(P(b=0)/P(b=1)) of coded
+     * bits, any positive scale.
+     * @return nBits decoded data bits.
+     */
+    BitStream decode(std::span<const float> LLRs)
+    {
+        BitStream output;
+        decode( LLRs, output );
+        return output;
+    }
+
+
+    /**
+     * Decode soft input into a caller's stream, its memory is reused.
+     *
+     * @param LLRs is getCodedSize(nBits) LLRs of coded bits.
+     * @param output is nBits decoded data bits, overwritten.
+     */
+    void decode(std::span<const float> LLRs, BitStream& output)
+    {
+        viterbi( LLRs.size() / 2, [&](std::size_t step, float& first, float& second) {
+            first  = LLRs[ 2 * step ];
+            second = LLRs[ 2 * step + 1 ];
+        }, output );
+    }
+
+
+    /**
+     * Decode hard input: every bit is an LLR of the same magnitude.
+     *
+     * @param inputData is a data with at least nCodedBits bits.
+     * @param nCodedBits is getCodedSize(nBits).
+     * @return nBits decoded data bits.
+     */
+    BitStream decode(const BitStream& inputData, std::size_t nCodedBits)
+    {
+        BitStream output;
+        decode( inputData, nCodedBits, output );
+        return output;
+    }
+
+
+    /**
+     * Decode hard input into a caller's stream, its memory is reused.
+     *
+     * @param inputData is a data with at least nCodedBits bits.
+     * @param nCodedBits is getCodedSize(nBits).
+     * @param output is nBits decoded data bits, overwritten.
+     */
+    void decode(const BitStream& inputData, std::size_t nCodedBits, BitStream& output)
+    {
+        viterbi( nCodedBits / 2, [&](std::size_t step, float& first, float& second) {
+            unsigned bits = inputData.read( 2 * step, 2 );
+            first  = bits & 2 ? -1.0f : 1.0f;
+            second = bits & 1 ? -1.0f : 1.0f;
+        }, output );
+    }
+
+
+
+private:
+
+
+    // Steps output at once and steps traced back before them.
+    static constexpr std::size_t WINDOW = 64;
+    static constexpr std::size_t DEPTH  = 64;
+    static constexpr std::size_t RING   = WINDOW + DEPTH;
+
+
+    static unsigned parity(unsigned x)
+    {
+        return std::popcount( x ) & 1;
+    }
+
+
+    /**
+     * Signs of coded bits of the branches of butterflies. Butterfly j
+     * joins states 2j and 2j+1 to states j (data bit 0) and j+32 (data
+     * bit 1); bit b of the branch from state s with data bit u is
+     * parity of (u << 6 | s) & GENERATORS[b]. Sign is +1 for bit 0.
+     */
+    struct BranchSigns {
+        float values[2][2][2][N_STATES / 2];    // [data bit][lower state][coded bit][j].
+    };
+
+
+    static const BranchSigns& branchSigns()
+    {
+        static const BranchSigns signs = [] {
+            BranchSigns output;
+            for (unsigned u = 0; u < 2; u++)
+                for (unsigned x = 0; x < 2; x++)
+                    for (unsigned b = 0; b < 2; b++)
+                        for (unsigned j = 0; j < N_STATES / 2; j++)
+                            output.values[u][x][b][j] = parity( (u << (CONSTRAINT_LENGTH - 1) | (2 * j + x)) & GENERATORS[b] ) ? -1.0f : 1.0f;
+            return output;
+        }();
+        return signs;
+    }
+
+
+    // Viterbi decoder over nSteps steps, input(step, first, second) gives
+    // LLRs of the two coded bits of a step. Decoded bits replace output.
+    template <typename Input>
+    void viterbi(std::size_t nSteps, Input input, BitStream& output)
+    {
+        Profiler::Scope profile( Profiler::DECODE, nSteps );
+        output.clear();
+        std::size_t nBits = nSteps > N_TAIL_BITS ? nSteps - N_TAIL_BITS : 0;
+        output.reserve( nBits );
+
+        // Path metrics, start is the zero state.
+        alignas(64) float metrics[ N_STATES ];
+        alignas(64) float next[ N_STATES ];
+        std::fill( metrics, metrics + N_STATES, -1e30f );
+        metrics[0] = 0;
+
+        const BranchSigns& signs = branchSigns();
+        std::size_t outputSteps = 0;    // Steps whose bits are in output.
+        for (std::size_t step = 0; step < nSteps; step++) {
+            float first, second;
+            input( step, first, second );
+            std::uint8_t* decisions = decisions_[ step % RING ];
+            // Add-compare-select of all butterflies.
+            #pragma omp simd
+            for (int j = 0; j < N_STATES / 2; j++) {
+                float upper      = metrics[ 2 * j ];
+                float lower      = metrics[ 2 * j + 1 ];
+                float upperZero  = upper + signs.values[0][0][0][j] * first + signs.values[0][0][1][j] * second;
+                float lowerZero  = lower + signs.values[0][1][0][j] * first + signs.values[0][1][1][j] * second;
+                float upperOne   = upper + signs.values[1][0][0][j] * first + signs.values[1][0][1][j] * second;
+                float lowerOne   = lower + signs.values[1][1][0][j] * first + signs.values[1][1][1][j] * second;
+                next[j]                         = std::max( upperZero, lowerZero );
+                next[ j + N_STATES / 2 ]        = std::max( upperOne, lowerOne );
+                decisions[j]                    = lowerZero > upperZero;
+                decisions[ j + N_STATES / 2 ]   = lowerOne > upperOne;
+            }
+            // Keep metrics small: subtract metric of state 0 from time to time.
+            float offset = step % 32 == 31 ? next[0] : 0.0f;
+            #pragma omp simd
+            for (int s = 0; s < N_STATES; s++)
+                metrics[s] = next[s] - offset;
+
+            // Output a window of bits when DEPTH steps follow it.
+            if (step + 1 - outputSteps == RING) {
+                int best = int( std::max_element( metrics, metrics + N_STATES ) - metrics );
+                traceBack( step, best, outputSteps, outputSteps + WINDOW, nBits, output );
+                outputSteps += WINDOW;
+            }
+        }
+        // Tail bits brought the encoder to the zero state.
+        if (nSteps > 0)
+            traceBack( nSteps - 1, 0, outputSteps, nSteps, nBits, output );
+    }
+
+
+    // Trace the survivor of a state at a step back to step begin and
+    // append its data bits of steps [begin, end) which are below nBits.
+    void traceBack(std::size_t step, int state, std::size_t begin, std::size_t end, std::size_t nBits, BitStream& output)
+    {
+        std::uint8_t bits[ RING ];
+        for (std::size_t t = step + 1; t-- > begin; ) {
+            bits[ t - begin ] = state >> (CONSTRAINT_LENGTH - 2);
+            state = (state << 1 & (N_STATES - 1)) | decisions_[ t % RING ][ state ];
+        }
+        for (std::size_t t = begin; t < std::min( end, nBits ); t++)
+            output.append( bits[ t - begin ], 1 );
+    }
+
+
+
+    alignas(64) std::uint8_t decisions_[ RING ][ N_STATES ];
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_CONVOLUTIONALCODE_H
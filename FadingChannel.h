@@ -0,0 +1,240 @@
+// This class models flat fading before the noise of the channel: every
+// symbol is multiplied by a complex gain which stays constant over a block
+// of symbols (block fading, one symbol per block is fast flat fading).
+// Gains are Rayleigh (zero mean complex normal) or Rician (with a fixed
+// line-of-sight part) of unit mean power and come from their own stream of
+// the seed, so they do not change the noise of the channel. The receiver
+// knows the gains and equalizes symbols (zero forcing or MMSE) before the
+// slicer. Kernels work on separate arrays of real and imaginary parts
+// (SoA) with no branches, so complex multiply and divide are vectorized.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "NoiseGenerator.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FADINGCHANNEL_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FADINGCHANNEL_H
+
+
+// Fading of the channel.
+struct FadingParameters {
+    enum Model {
+        NONE,       // AWGN only.
+        RAYLEIGH,   // Complex normal gain.
+        RICIAN      // Line-of-sight part plus complex normal gain.
+    };
+    enum Equalizer {
+        ZERO_FORCING,   // Division by the gain.
+        MMSE            // Regularized by the noise to signal ratio.
+    };
+    Model           model           = NONE;
+    double          ricianFactor    = 1;    // K, power of line-of-sight part to scattered power.
+    std::uint64_t   blockSymbols    = 1;    // Symbols with the same gain.
+    Equalizer       equalizer       = ZERO_FORCING;
+};
+
+
+class FadingChannel {
+public:
+
+
+    /**
+     * Convert model name ("none", "rayleigh" or "rician") to model.
+     *
+     * @param name is a name of the model.
+     * @return model.
+     * @throws std::invalid_argument if name is unknown.
+     */
+    static FadingParameters::Model parseModel(const std::string& name)
+    {
+        if (name == "rayleigh")
+            return FadingParameters::RAYLEIGH;
+        if (name == "rician")
+            return FadingParameters::RICIAN;
+        if (name != "none")
+            throw std::invalid_argument( "Unknown fading model " + name + ", it must be none, rayleigh or rician" );
+        return FadingParameters::NONE;
+    }
+
+
+    /**
+     * Convert equalizer name ("zf" or "mmse") to equalizer.
+     *
+     * @param name is a name of the equalizer.
+     * @return equalizer.
+     * @throws std::invalid_argument if name is unknown.
+     */
+    static FadingParameters::Equalizer parseEqualizer(const std::string& name)
+    {
+        if (name == "mmse")
+            return FadingParameters::MMSE;
+        if (name != "zf")
+            throw std::invalid_argument( "Unknown equalizer " + name + ", it must be zf or mmse" );
+        return FadingParameters::ZERO_FORCING;
+    }
+
+
+    void setParameters(const FadingParameters& parameters)
+    {
+        parameters_ = parameters;
+        if (parameters_.blockSymbols == 0)
+            parameters_.blockSymbols = 1;
+    }
+
+
+    const FadingParameters& getParameters() const
+    {
+        return parameters_;
+    }
+
+
+    bool isEnabled() const
+    {
+        return parameters_.model != FadingParameters::NONE;
+    }
+
+
+    /**
+     * Restart gains at the first block of a given stream. Gains use the
+     * Philox source under a key derived from the seed, so they are
+     * independent of the noise of the same stream.
+     *
+     * @param seed is a seed of the channel.
+     * @param stream is an identifier of the trial.
+     */
+    void setSeed(std::uint64_t seed, std::uint64_t stream = 0)
+    {
+        gains_.setSource( NoiseGenerator::PHILOX );
+        gains_.setSeed( seed ^ 0xB7E151628AED2A6Bull, stream );
+        nextBlock_ = 0;
+    }
+
+
+    /**
+     * Write gains of symbols. Symbols must come in order from the first
+     * one after setSeed, calls may split blocks anywhere.
+     *
+     * @param firstSymbol is an index of the first symbol in the transmission.
+     * @param n is a number of symbols.
+     * @param gainRe is a buffer of n real parts of gains.
+     * @param gainIm is a buffer of n imaginary parts of gains.
+     */
+    void fillGains(std::uint64_t firstSymbol, std::size_t n, double* gainRe, double* gainIm)
+    {
+        double lineOfSight = 0;
+        double scattered   = std::sqrt( 0.5 );
+        if (parameters_.model == FadingParameters::RICIAN) {
+            double K = std::max( parameters_.ricianFactor, 0.0 );
+            lineOfSight = std::sqrt( K / (K + 1) );
+            scattered   = std::sqrt( 0.5 / (K + 1) );
+        }
+        if (n == 0)
+            return;
+        // New blocks of the call take the next pairs of normal samples,
+        // all at once.
+        std::uint64_t blockSymbols = parameters_.blockSymbols;
+        std::uint64_t firstBlock   = firstSymbol / blockSymbols;
+        std::uint64_t lastBlock    = (firstSymbol + n - 1) / blockSymbols;
+        std::uint64_t nNewBlocks   = lastBlock + 1 - std::max( nextBlock_, firstBlock );
+        pairs_.resize( 2 * nNewBlocks );
+        gains_.fillGaussian( pairs_.data(), pairs_.size() );
+        nextBlock_ = lastBlock + 1;
+        if (blockSymbols == 1) {
+            // Fast fading: a gain per symbol.
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; i++) {
+                gainRe[i] = lineOfSight + scattered * pairs_[ 2 * i ];
+                gainIm[i] = scattered * pairs_[ 2 * i + 1 ];
+            }
+            return;
+        }
+        std::size_t pair = 0;
+        for (std::size_t i = 0; i < n; ) {
+            std::uint64_t block = (firstSymbol + i) / blockSymbols;
+            // Block which started in the previous call keeps its gain.
+            if (block > firstBlock || firstBlock + nNewBlocks > lastBlock) {
+                gainRe_ = lineOfSight + scattered * pairs_[ 2 * pair ];
+                gainIm_ = scattered * pairs_[ 2 * pair + 1 ];
+                pair++;
+            }
+            std::size_t end = std::min<std::uint64_t>( n, (block + 1) * blockSymbols - firstSymbol );
+            for (; i < end; i++) {
+                gainRe[i] = gainRe_;
+                gainIm[i] = gainIm_;
+            }
+        }
+    }
+
+
+    /**
+     * Multiply symbols by gains in place.
+     *
+     * @param gainRe is a buffer of n real parts of gains.
+     * @param gainIm is a buffer of n imaginary parts of gains.
+     * @param re is a buffer of n real parts of symbols.
+     * @param im is a buffer of n imaginary parts of symbols.
+     * @param n is a number of symbols.
+     */
+    static void fade(const double* gainRe, const double* gainIm, double* re, double* im, std::size_t n)
+    {
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double x = re[i];
+            double y = im[i];
+            re[i] = gainRe[i] * x - gainIm[i] * y;
+            im[i] = gainRe[i] * y + gainIm[i] * x;
+        }
+    }
+
+
+    /**
+     * Equalize symbols in place: multiply by conj(h) / (|h|^2 + r). Zero
+     * forcing (r = 0) gives the transmitted point plus noise. MMSE (r is
+     * noise to signal power ratio) has lower mean square error, but its
+     * estimate is shrunk towards zero, so for orders above 4 the slicer
+     * makes more errors on weak gains than with zero forcing.
+     *
+     * @param gainRe is a buffer of n real parts of gains.
+     * @param gainIm is a buffer of n imaginary parts of gains.
+     * @param re is a buffer of n real parts of symbols.
+     * @param im is a buffer of n imaginary parts of symbols.
+     * @param n is a number of symbols.
+     * @param regularization is r, zero for zero forcing.
+     */
+    static void equalize(const double* gainRe, const double* gainIm, double* re, double* im, std::size_t n,
+                         double regularization)
+    {
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double scale = 1 / (gainRe[i] * gainRe[i] + gainIm[i] * gainIm[i] + regularization);
+            double x = re[i];
+            double y = im[i];
+            re[i] = (gainRe[i] * x + gainIm[i] * y) * scale;
+            im[i] = (gainRe[i] * y - gainIm[i] * x) * scale;
+        }
+    }
+
+
+
+private:
+
+
+    FadingParameters    parameters_;
+    NoiseGenerator      gains_;
+    std::uint64_t       nextBlock_  = 0;
+    double              gainRe_     = 1;    // Gain of block nextBlock_ - 1.
+    double              gainIm_     = 0;
+    std::vector<double> pairs_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FADINGCHANNEL_H
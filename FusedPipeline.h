@@ -0,0 +1,424 @@
+// This class transmits data through the whole chain (mapping, noise,
+// slicing, error counting) in one pass over small chunks of symbols.
+// Only running error count is kept, so memory does not depend on the
+// payload length, and every chunk stays in cache between the stages.
+// Noise of a chunk is the same as in the staged chain, so both give the
+// same errors for the same seed and stream. Single precision mode keeps
+// symbols as separate float arrays of real and imaginary parts from the
+// mapper to the slicer: twice the SIMD lanes and half the memory traffic
+// of doubles, with its own noise samples, so errors agree with the double
+// chain only statistically. With an ADC (see AdcQuantizer) noisy samples
+// of the double chain are quantized to int16 codes and sliced as
+// integers, so every resolution sees the same noise as the double chain.
+
+#include <algorithm>
+#include <bit>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AdcQuantizer.h"
+#include "Profiler.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FUSEDPIPELINE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FUSEDPIPELINE_H
+
+
+class FusedPipeline {
+public:
+
+
+    // Number of symbols processed at once (32 KiB of samples).
+    static constexpr std::size_t CHUNK_SYMBOLS = 2048;
+
+
+    // Type of samples between the mapper and the slicer.
+    enum Precision {
+        DOUBLE,     // std::complex<double> symbols.
+        SINGLE      // float arrays of real and imaginary parts.
+    };
+
+
+    FusedPipeline()
+        : codes_( CHUNK_SYMBOLS ), samples_( CHUNK_SYMBOLS ), indices_( CHUNK_SYMBOLS ), weights_( CHUNK_SYMBOLS ),
+          points_( CHUNK_SYMBOLS ), unitNoise_( 2 * CHUNK_SYMBOLS ), re_( CHUNK_SYMBOLS ), im_( CHUNK_SYMBOLS ),
+          pointRe_( CHUNK_SYMBOLS ), pointIm_( CHUNK_SYMBOLS ), sampleRe_( CHUNK_SYMBOLS ), sampleIm_( CHUNK_SYMBOLS ),
+          floatNoise_( 2 * CHUNK_SYMBOLS ), codeRe_( CHUNK_SYMBOLS ), codeIm_( CHUNK_SYMBOLS ),
+          shortIndices_( CHUNK_SYMBOLS )
+    {
+    }
+
+
+    /**
+     * Convert precision name ("double" or "float") to precision.
+     *
+     * @param name is a name of the precision.
+     * @return precision.
+     * @throws std::invalid_argument if name is unknown.
+     */
+    static Precision parsePrecision(const std::string& name)
+    {
+        if (name == "float")
+            return SINGLE;
+        if (name != "double")
+            throw std::invalid_argument( "Unknown precision " + name + ", it must be double, float or check" );
+        return DOUBLE;
+    }
+
+
+    // Chooses type of samples of countErrors and countErrorsCommonNoise
+    // (importance sampling and fading are always in double precision).
+    void setPrecision(Precision precision)
+    {
+        precision_ = precision;
+    }
+
+
+    Precision getPrecision() const
+    {
+        return precision_;
+    }
+
+
+    // Sets ADC of the receiver of countErrors (AWGN in double precision
+    // only). Zero bits turn it off.
+    void setAdc(const AdcParameters& parameters)
+    {
+        adc_.setParameters( parameters );
+    }
+
+
+    const AdcParameters& getAdc() const
+    {
+        return adc_.getParameters();
+    }
+
+
+    /**
+     * Transmit data through the channel and count bit errors.
+     *
+     * @param inputData is a data to transmit. Any type with size() (number
+     * of bits) and read(position, nBits) like BitStream.
+     * @param channel is a channel with modulation order, seed and stream
+     * already set. Its noise generator advances.
+     * @param SNR is a signal-to-noise ratio value (Eb/N0) in dB.
+     * @return number of wrong bits among inputData.size() bits.
+     */
+    template <typename Source>
+    std::uint64_t countErrors(const Source& inputData, GaussianChannel& channel, double SNR)
+    {
+        if (precision_ == SINGLE && channel.getFading().model == FadingParameters::NONE)
+            return transmitSingle( inputData, channel, SNR );
+        if (adc_.isEnabled() && channel.getFading().model == FadingParameters::NONE)
+            return transmitQuantized( inputData, channel, SNR );
+        return transmit( inputData, channel, SNR, nullptr );
+    }
+
+
+    /**
+     * Transmit data once per SNR value with common random numbers: unit
+     * noise of a chunk is generated once and scaled by sigma of every SNR,
+     * so errors at neighbouring SNR values are strongly correlated and
+     * noise costs as much as at a single SNR. Errors at any of the SNR
+     * values are the same as of countErrors with the same stream.
+     *
+     * @param inputData is a data to transmit (see countErrors).
+     * @param channel is a channel with modulation order, seed and stream set.
+     * @param SNR is a vector of signal-to-noise ratio values (Eb/N0) in dB.
+     * @param errors is a buffer of SNR.size() numbers of wrong bits to write.
+     */
+    template <typename Source>
+    void countErrorsCommonNoise(const Source& inputData, GaussianChannel& channel, std::span<const double> SNR,
+                                std::span<std::uint64_t> errors)
+    {
+        const ConstellationTable&           table           = channel.getConstellationTable();
+        int                                 bitsPerSymbol   = table.getBitsPerSymbol();
+        int                                 nReImValues     = table.getNumberOfAxisValues();
+        std::span<const std::complex<int> > pointsOfCodes   = table.getPointsOfCodes();
+        std::span<const int>                GreyCodes       = table.getGreyCodes();
+        std::size_t                         nBits           = inputData.size();
+        std::size_t                         nSymbols        = (nBits + bitsPerSymbol - 1) / bitsPerSymbol;
+        bool                                single          = precision_ == SINGLE;
+
+        sigmas_.resize( SNR.size() );
+        lastDifferences_.assign( SNR.size(), 0 );
+        for (std::size_t s = 0; s < SNR.size(); s++) {
+            sigmas_[s] = channel.getNoiseDeviation( SNR[s] );
+            errors[s]  = 0;
+        }
+        for (std::size_t begin = 0; begin < nSymbols; begin += CHUNK_SYMBOLS) {
+            std::size_t count = std::min( CHUNK_SYMBOLS, nSymbols - begin );
+            if (single) {
+                qamModulator::mapData( inputData, begin, count, table, codes_.data(), pointRe_.data(), pointIm_.data() );
+                channel.fillUnitNoise( floatNoise_.data(), 2 * count );
+            }
+            else {
+                {
+                    Profiler::Scope profile( Profiler::MAP, count );
+                    for (std::size_t i = 0; i < count; i++) {
+                        codes_[i] = inputData.read( (begin + i) * bitsPerSymbol, bitsPerSymbol );
+                        std::complex<int> point = pointsOfCodes[ codes_[i] ];
+                        points_[i] = std::complex<double>( point.real(), point.imag() );
+                    }
+                }
+                channel.fillUnitNoise( unitNoise_.data(), 2 * count );
+            }
+            const double* points = reinterpret_cast<const double*>( points_.data() );
+            double*       samples = reinterpret_cast<double*>( samples_.data() );
+            const double* noise  = unitNoise_.data();
+            for (std::size_t s = 0; s < SNR.size(); s++) {
+                // Same arithmetic as NoiseGenerator::addGaussian.
+                double sigma = sigmas_[s];
+                if (single) {
+                    // Real parts take the first count samples, as in
+                    // GaussianChannel::addGaussianNoise.
+                    float        floatSigma = float( sigma );
+                    const float* noiseRe    = floatNoise_.data();
+                    const float* noiseIm    = floatNoise_.data() + count;
+                    {
+                        Profiler::Scope profile( Profiler::NOISE, count );
+                        #pragma omp simd
+                        for (std::size_t i = 0; i < count; i++) {
+                            sampleRe_[i] = pointRe_[i] + floatSigma * noiseRe[i];
+                            sampleIm_[i] = pointIm_[i] + floatSigma * noiseIm[i];
+                        }
+                    }
+                    Profiler::Scope profile( Profiler::DEMAP, count );
+                    qamDemodulator::sliceData( sampleRe_.data(), sampleIm_.data(), count, nReImValues, indices_.data() );
+                }
+                else {
+                    {
+                        Profiler::Scope profile( Profiler::NOISE, count );
+                        #pragma omp simd
+                        for (std::size_t i = 0; i < 2 * count; i++)
+                            samples[i] = points[i] + sigma * noise[i];
+                    }
+                    Profiler::Scope profile( Profiler::DEMAP, count );
+                    qamDemodulator::sliceData( samples_.data(), count, nReImValues, indices_.data() );
+                }
+                Profiler::Scope profile( Profiler::COUNT, count );
+                std::uint64_t chunkErrors = 0;
+                for (std::size_t i = 0; i < count; i++)
+                    chunkErrors += std::popcount( codes_[i] ^ unsigned( GreyCodes[ indices_[i] ] ) );
+                errors[s] += chunkErrors;
+                lastDifferences_[s] = codes_[ count - 1 ] ^ unsigned( GreyCodes[ indices_[ count - 1 ] ] );
+            }
+        }
+        // Padding bits of the last symbol were not transmitted.
+        int nPaddingBits = nSymbols * bitsPerSymbol - nBits;
+        for (std::size_t s = 0; s < SNR.size(); s++)
+            errors[s] -= std::popcount( lastDifferences_[s] & ((1u << nPaddingBits) - 1) );
+    }
+
+
+    /**
+     * Transmit data with importance sampling noise (see
+     * GaussianChannel::addImportanceNoise) and count bit errors.
+     *
+     * @param inputData is a data to transmit (see countErrors).
+     * @param channel is a channel with modulation order, seed and stream set.
+     * @param SNR is a signal-to-noise ratio value (Eb/N0) in dB.
+     * @param weightedErrors is a sum of bit errors of every symbol multiplied
+     * by its likelihood ratio, an unbiased estimate of AWGN errors.
+     * @return number of wrong bits under biased noise.
+     */
+    template <typename Source>
+    std::uint64_t countWeightedErrors(const Source& inputData, GaussianChannel& channel, double SNR,
+                                      double& weightedErrors)
+    {
+        return transmit( inputData, channel, SNR, &weightedErrors );
+    }
+
+
+
+private:
+
+
+    // Common loop of countErrors and countWeightedErrors. Importance
+    // sampling is used when weightedErrors is not null, otherwise fading
+    // of the channel (on separate real and imaginary arrays) if it is set.
+    template <typename Source>
+    std::uint64_t transmit(const Source& inputData, GaussianChannel& channel, double SNR, double* weightedErrors)
+    {
+        const ConstellationTable&           table           = channel.getConstellationTable();
+        int                                 bitsPerSymbol   = table.getBitsPerSymbol();
+        int                                 nReImValues     = table.getNumberOfAxisValues();
+        std::span<const std::complex<int> > pointsOfCodes   = table.getPointsOfCodes();
+        std::span<const int>                GreyCodes       = table.getGreyCodes();
+        std::size_t                         nBits           = inputData.size();
+        std::size_t                         nSymbols        = (nBits + bitsPerSymbol - 1) / bitsPerSymbol;
+
+        bool          faded  = !weightedErrors && channel.getFading().model != FadingParameters::NONE;
+        std::uint64_t errors = 0;
+        double        weighted = 0;
+        unsigned      lastDifference = 0;
+        double        lastWeight = 1;
+        for (std::size_t begin = 0; begin < nSymbols; begin += CHUNK_SYMBOLS) {
+            std::size_t count = std::min( CHUNK_SYMBOLS, nSymbols - begin );
+            // Map.
+            {
+                Profiler::Scope profile( Profiler::MAP, count );
+                for (std::size_t i = 0; i < count; i++) {
+                    codes_[i] = inputData.read( (begin + i) * bitsPerSymbol, bitsPerSymbol );
+                    std::complex<int> point = pointsOfCodes[ codes_[i] ];
+                    if (faded) {
+                        re_[i] = point.real();
+                        im_[i] = point.imag();
+                    }
+                    else
+                        samples_[i] = std::complex<double>( point.real(), point.imag() );
+                }
+            }
+            // Add noise.
+            if (faded)
+                channel.addFadingNoise( re_.data(), im_.data(), count, SNR, begin );
+            else if (weightedErrors)
+                channel.addImportanceNoise( samples_.data(), count, SNR, begin, weights_.data() );
+            else
+                channel.addGaussianNoise( samples_.data(), count, SNR );
+            // Demap and compare codes of symbols.
+            {
+                Profiler::Scope profile( Profiler::DEMAP, count );
+                if (faded)
+                    qamDemodulator::sliceData( re_.data(), im_.data(), count, nReImValues, indices_.data() );
+                else
+                    qamDemodulator::sliceData( samples_.data(), count, nReImValues, indices_.data() );
+            }
+            Profiler::Scope profile( Profiler::COUNT, count );
+            for (std::size_t i = 0; i < count; i++) {
+                unsigned difference = codes_[i] ^ GreyCodes[ indices_[i] ];
+                errors += std::popcount( difference );
+                lastDifference = difference;
+            }
+            if (weightedErrors) {
+                for (std::size_t i = 0; i < count; i++)
+                    weighted += weights_[i] * std::popcount( codes_[i] ^ unsigned( GreyCodes[ indices_[i] ] ) );
+                lastWeight = weights_[ count - 1 ];
+            }
+        }
+        // Padding bits of the last symbol were not transmitted.
+        int nPaddingBits = nSymbols * bitsPerSymbol - nBits;
+        int paddingErrors = std::popcount( lastDifference & ((1u << nPaddingBits) - 1) );
+        errors -= paddingErrors;
+        if (weightedErrors)
+            *weightedErrors = weighted - lastWeight * paddingErrors;
+        return errors;
+    }
+
+
+
+    // Loop of countErrors in single precision.
+    template <typename Source>
+    std::uint64_t transmitSingle(const Source& inputData, GaussianChannel& channel, double SNR)
+    {
+        const ConstellationTable&   table           = channel.getConstellationTable();
+        int                         bitsPerSymbol   = table.getBitsPerSymbol();
+        int                         nReImValues     = table.getNumberOfAxisValues();
+        std::span<const int>        GreyCodes       = table.getGreyCodes();
+        std::size_t                 nBits           = inputData.size();
+        std::size_t                 nSymbols        = (nBits + bitsPerSymbol - 1) / bitsPerSymbol;
+
+        std::uint64_t errors = 0;
+        unsigned      lastDifference = 0;
+        for (std::size_t begin = 0; begin < nSymbols; begin += CHUNK_SYMBOLS) {
+            std::size_t count = std::min( CHUNK_SYMBOLS, nSymbols - begin );
+            qamModulator::mapData( inputData, begin, count, table, codes_.data(), sampleRe_.data(), sampleIm_.data() );
+            channel.addGaussianNoise( sampleRe_.data(), sampleIm_.data(), count, SNR );
+            {
+                Profiler::Scope profile( Profiler::DEMAP, count );
+                qamDemodulator::sliceData( sampleRe_.data(), sampleIm_.data(), count, nReImValues, indices_.data() );
+            }
+            Profiler::Scope profile( Profiler::COUNT, count );
+            for (std::size_t i = 0; i < count; i++) {
+                unsigned difference = codes_[i] ^ GreyCodes[ indices_[i] ];
+                errors += std::popcount( difference );
+                lastDifference = difference;
+            }
+        }
+        // Padding bits of the last symbol were not transmitted.
+        int nPaddingBits = nSymbols * bitsPerSymbol - nBits;
+        return errors - std::popcount( lastDifference & ((1u << nPaddingBits) - 1) );
+    }
+
+
+
+    // Loop of countErrors with the ADC: noise as in transmit, integer slicer.
+    template <typename Source>
+    std::uint64_t transmitQuantized(const Source& inputData, GaussianChannel& channel, double SNR)
+    {
+        const ConstellationTable&           table           = channel.getConstellationTable();
+        int                                 bitsPerSymbol   = table.getBitsPerSymbol();
+        int                                 nReImValues     = table.getNumberOfAxisValues();
+        std::span<const std::complex<int> > pointsOfCodes   = table.getPointsOfCodes();
+        std::span<const int>                GreyCodes       = table.getGreyCodes();
+        std::size_t                         nBits           = inputData.size();
+        std::size_t                         nSymbols        = (nBits + bitsPerSymbol - 1) / bitsPerSymbol;
+
+        adc_.configure( nReImValues, channel.getNoiseDeviation( SNR ) );
+        std::uint64_t errors = 0;
+        unsigned      lastDifference = 0;
+        for (std::size_t begin = 0; begin < nSymbols; begin += CHUNK_SYMBOLS) {
+            std::size_t count = std::min( CHUNK_SYMBOLS, nSymbols - begin );
+            {
+                Profiler::Scope profile( Profiler::MAP, count );
+                for (std::size_t i = 0; i < count; i++) {
+                    codes_[i] = inputData.read( (begin + i) * bitsPerSymbol, bitsPerSymbol );
+                    std::complex<int> point = pointsOfCodes[ codes_[i] ];
+                    samples_[i] = std::complex<double>( point.real(), point.imag() );
+                }
+            }
+            channel.addGaussianNoise( samples_.data(), count, SNR );
+            {
+                Profiler::Scope profile( Profiler::QUANTIZE, count );
+                adc_.quantize( samples_.data(), count, codeRe_.data(), codeIm_.data() );
+            }
+            {
+                Profiler::Scope profile( Profiler::DEMAP, count );
+                qamDemodulator::sliceData( codeRe_.data(), codeIm_.data(), count, nReImValues, adc_.getThresholds(),
+                                           shortIndices_.data() );
+            }
+            Profiler::Scope profile( Profiler::COUNT, count );
+            for (std::size_t i = 0; i < count; i++) {
+                unsigned difference = codes_[i] ^ GreyCodes[ shortIndices_[i] ];
+                errors += std::popcount( difference );
+                lastDifference = difference;
+            }
+        }
+        // Padding bits of the last symbol were not transmitted.
+        int nPaddingBits = nSymbols * bitsPerSymbol - nBits;
+        return errors - std::popcount( lastDifference & ((1u << nPaddingBits) - 1) );
+    }
+
+
+
+    std::vector<unsigned>               codes_;
+    std::vector<std::complex<double> >  samples_;
+    std::vector<int>                    indices_;
+    std::vector<double>                 weights_;
+    std::vector<std::complex<double> >  points_;
+    std::vector<double>                 unitNoise_;
+    std::vector<double>                 sigmas_;
+    std::vector<unsigned>               lastDifferences_;
+    std::vector<double>                 re_;
+    std::vector<double>                 im_;
+    std::vector<float>                  pointRe_;
+    std::vector<float>                  pointIm_;
+    std::vector<float>                  sampleRe_;
+    std::vector<float>                  sampleIm_;
+    std::vector<float>                  floatNoise_;
+    std::vector<std::int16_t>           codeRe_;
+    std::vector<std::int16_t>           codeIm_;
+    std::vector<std::int16_t>           shortIndices_;
+    Precision                           precision_ = DOUBLE;
+    AdcQuantizer                        adc_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_FUSEDPIPELINE_H
@@ -4,7 +4,16 @@
 //
 // Created by Konstantin Terentev on 05.09.2024 for YADRO.
 
-#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "FadingChannel.h"
+#include "NoiseGenerator.h"
+#include "Profiler.h"
 
 #ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_GAUSSIANCHANNEL_H
 #define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_GAUSSIANCHANNEL_H
@@ -15,19 +24,49 @@ public:
 
 
     /**
-     * Add white Gaussian noise.
+     * Restart noise generator at the beginning of a given stream. Two
+     * channels with the same source, seed and stream produce the same noise.
+     *
+     * @param seed is a seed of the noise generator.
+     * @param stream is an identifier of an independent noise sequence.
+     */
+    void setSeed(std::uint64_t seed, std::uint64_t stream = 0)
+    {
+        noise_.setSeed( seed, stream );
+        fading_.setSeed( seed, stream );
+    }
+
+
+    // Chooses fading before the noise (see FadingChannel), used by addFadingNoise.
+    void setFading(const FadingParameters& parameters)
+    {
+        fading_.setParameters( parameters );
+    }
+
+
+    const FadingParameters& getFading() const
+    {
+        return fading_.getParameters();
+    }
+
+
+    // Chooses generator of noise samples (see NoiseGenerator).
+    void setNoiseSource(NoiseGenerator::Source source)
+    {
+        noise_.setSource( source );
+    }
+
+
+    /**
+     * Calculate standard deviation of noise in each of real and
+     * imaginary parts.
      *
-     * @param inputSignal is a complex vector of double modulated data.
      * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
-     * @return complex vector of modulated noised data.
+     * @return standard deviation of noise.
      */
-    std::vector<std::complex<double> > addGaussianNoise(const std::vector<std::complex<double> >& inputSignal,
-                                                        double SNR)
+    double getNoiseDeviation(double SNR)
     {
-        std::vector<std::complex<double> >  outputSignal;
-        std::vector<std::complex<double> >  AWGN;
-        std::random_device                  generateNumber;
-        std::vector<std::complex<int> >     complexValuesConstellation = qamModulator::createComplexValuesConstellation(log2(getModulationOrder()));
+        int bitsPerSymbol = getConstellationTable().getBitsPerSymbol();
 //        // Calculating constellation energy
 //        double E = 0;
 //        for (std::complex<int> i : complexValuesConstellation) {
@@ -38,14 +77,175 @@ public:
 //        // Calculating bit energy
 //        double Eb = Es/log2(getModulationOrder());
         // Calculating average bit energy via special formula
-        double Eb = (getModulationOrder()-1)/(3*log2(getModulationOrder()));
+        double Eb = (getModulationOrder()-1)/(3.0*bitsPerSymbol);
         // Calculating noise density
         double No = Eb/pow(10,(SNR)/10);
-        // Adding noise
-        std::normal_distribution<double> N(0, sqrt(No/2));
-        for (std::complex<double> i : inputSignal) {
-            outputSignal.push_back(i + std::complex<double>(N(generateNumber), N(generateNumber)));
+        return sqrt(No/2);
+    }
+
+
+    /**
+     * Add white Gaussian noise in place.
+     *
+     * @param signal is a buffer of n modulated symbols.
+     * @param n is a number of symbols.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     */
+    void addGaussianNoise(std::complex<double>* signal, std::size_t n, double SNR)
+    {
+        Profiler::Scope profile( Profiler::NOISE, n );
+        // Array of complex is an array of (real, imag) pairs, so both
+        // components are noised in one pass over the buffer.
+        noise_.addGaussian(reinterpret_cast<double*>(signal), 2 * n, getNoiseDeviation(SNR));
+    }
+
+
+    /**
+     * Add white Gaussian noise in place to symbols in single precision,
+     * given as separate arrays of real and imaginary parts. Noise samples
+     * are the single precision ones (see NoiseGenerator), real parts take
+     * the first n of them and imaginary parts the next n.
+     *
+     * @param re is a buffer of n real parts of modulated symbols.
+     * @param im is a buffer of n imaginary parts of modulated symbols.
+     * @param n is a number of symbols.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     */
+    void addGaussianNoise(float* re, float* im, std::size_t n, double SNR)
+    {
+        Profiler::Scope profile( Profiler::NOISE, n );
+        float sigma = float( getNoiseDeviation(SNR) );
+        noise_.addGaussian(re, n, sigma);
+        noise_.addGaussian(im, n, sigma);
+    }
+
+
+    /**
+     * Pass symbols through fading, add white Gaussian noise and equalize
+     * in place. Noise samples are the same as of addGaussianNoise, so
+     * without fading the result is the same. Mean power of gains is one,
+     * so SNR is the average one.
+     *
+     * @param re is a buffer of n real parts of modulated symbols.
+     * @param im is a buffer of n imaginary parts of modulated symbols.
+     * @param n is a number of symbols.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     * @param firstSymbol is an index of the first symbol in the transmission,
+     * symbols must come in order after setSeed.
+     */
+    void addFadingNoise(double* re, double* im, std::size_t n, double SNR, std::uint64_t firstSymbol)
+    {
+        double sigma = getNoiseDeviation(SNR);
+        gainRe_.resize(n);
+        gainIm_.resize(n);
+        unitNoise_.resize(2 * n);
+        if (fading_.isEnabled()) {
+            Profiler::Scope profile( Profiler::FADING, n );
+            fading_.fillGains( firstSymbol, n, gainRe_.data(), gainIm_.data() );
+            FadingChannel::fade( gainRe_.data(), gainIm_.data(), re, im, n );
+        }
+        {
+            Profiler::Scope profile( Profiler::NOISE, n );
+            noise_.fillGaussian(unitNoise_.data(), 2 * n);
+            const double* noise = unitNoise_.data();
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; i++) {
+                re[i] += sigma * noise[2 * i];
+                im[i] += sigma * noise[2 * i + 1];
+            }
         }
+        if (fading_.isEnabled()) {
+            Profiler::Scope profile( Profiler::FADING, n );
+            // Noise to signal power ratio, signal power is 2(M-1)/3.
+            double regularization = fading_.getParameters().equalizer == FadingParameters::MMSE
+                                  ? 3 * sigma * sigma / (getModulationOrder() - 1) : 0;
+            FadingChannel::equalize( gainRe_.data(), gainIm_.data(), re, im, n, regularization );
+        }
+    }
+
+
+    /**
+     * Write unit variance noise samples, the same ones addGaussianNoise
+     * would scale, to reuse them at several SNR values.
+     *
+     * @param output is a buffer of n values.
+     * @param n is a number of values (two per symbol).
+     */
+    void fillUnitNoise(double* output, std::size_t n)
+    {
+        Profiler::Scope profile( Profiler::NOISE, n / 2 );
+        noise_.fillGaussian(output, n);
+    }
+
+
+    /**
+     * Write unit variance noise samples in single precision, the same
+     * ones the single precision addGaussianNoise would scale.
+     *
+     * @param output is a buffer of n values.
+     * @param n is a number of values (two per symbol).
+     */
+    void fillUnitNoise(float* output, std::size_t n)
+    {
+        Profiler::Scope profile( Profiler::NOISE, n / 2 );
+        noise_.fillGaussian(output, n);
+    }
+
+
+    /**
+     * Add biased noise for importance sampling in place. Noise of every
+     * symbol is shifted to the decision boundary (by half of the distance
+     * between points) along +re, -re, +im or -im chosen at random, so errors
+     * become frequent. Weight of a symbol is the ratio of AWGN density to
+     * the density of this equal mixture of four shifted ones, so the sum of
+     * errors multiplied by weights estimates AWGN errors without bias.
+     * The direction must not depend on data, otherwise the estimate is biased.
+     *
+     * @param signal is a buffer of n modulated symbols.
+     * @param n is a number of symbols.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     * @param firstSymbol is an index of the first symbol in the transmission.
+     * @param weights is a buffer of n likelihood ratios to write.
+     */
+    void addImportanceNoise(std::complex<double>* signal, std::size_t n, double SNR,
+                            std::size_t firstSymbol, double* weights)
+    {
+        Profiler::Scope profile( Profiler::NOISE, n );
+        Profiler::addRandomDraws( n );     // Directions.
+        double sigma = getNoiseDeviation(SNR);
+        double shift = 1;
+        // Ratio is 4 / sum of exp(+-a - c) and exp(+-b - c), where a and b are
+        // noise components multiplied by shift/sigma^2 and c = shift^2/(2 sigma^2).
+        double scale  = shift / (sigma * sigma);
+        double offset = shift * shift / (2 * sigma * sigma);
+        unitNoise_.resize(2 * n);
+        noise_.fillGaussian(unitNoise_.data(), 2 * n);
+        double* samples = reinterpret_cast<double*>(signal);
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint64_t direction = noise_.randomBits(firstSymbol + i) & 3;
+            double re = sigma * unitNoise_[2 * i]     + (direction == 0 ? shift : direction == 1 ? -shift : 0);
+            double im = sigma * unitNoise_[2 * i + 1] + (direction == 2 ? shift : direction == 3 ? -shift : 0);
+            samples[2 * i]     += re;
+            samples[2 * i + 1] += im;
+            double a = re * scale;
+            double b = im * scale;
+            weights[i] = 4 / (exp(a - offset) + exp(-a - offset) + exp(b - offset) + exp(-b - offset));
+        }
+    }
+
+
+    /**
+     * Add white Gaussian noise.
+     *
+     * @param inputSignal is a complex vector of double modulated data.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     * @return complex vector of modulated noised data.
+     */
+    std::vector<std::complex<double> > addGaussianNoise(const std::vector<std::complex<double> >& inputSignal,
+                                                        double SNR)
+    {
+        std::vector<std::complex<double> > outputSignal = inputSignal;
+        addGaussianNoise(outputSignal.data(), outputSignal.size(), SNR);
         return outputSignal;
     }
 
@@ -60,27 +260,55 @@ public:
     std::vector<std::complex<double> > addGaussianNoise(const std::vector<std::complex<int> >& inputSignal,
                                                         double SNR)
     {
-        std::vector<std::complex<double> > inputSignalDouble = cast<double, int>(inputSignal);
-        std::vector<std::complex<double> > outputSignal = addGaussianNoise(inputSignalDouble, SNR);
+        std::vector<std::complex<double> > outputSignal( inputSignal.size() );
+        addGaussianNoise(std::span<const std::complex<int> >(inputSignal), SNR, outputSignal);
         return outputSignal;
     }
 
 
-
-private:
+    /**
+     * Add white Gaussian noise into a caller's buffer, nothing is allocated.
+     *
+     * @param inputSignal is a buffer of integer modulated symbols.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     * @param outputSignal is a buffer of inputSignal.size() noised symbols.
+     */
+    void addGaussianNoise(std::span<const std::complex<int> > inputSignal, double SNR,
+                          std::span<std::complex<double> > outputSignal)
+    {
+        for (std::size_t i = 0; i < inputSignal.size(); i++)
+            outputSignal[i] = std::complex<double>( inputSignal[i].real(), inputSignal[i].imag() );
+        addGaussianNoise(outputSignal.data(), inputSignal.size(), SNR);
+    }
 
 
-    // Changes type of elements in vector.
-    template <typename O, typename I> std::vector<std::complex<O> > cast(const std::vector<std::complex<I> > inputData)
+    /**
+     * Add white Gaussian noise into a caller's buffer, nothing is allocated.
+     *
+     * @param inputSignal is a buffer of modulated samples.
+     * @param SNR is a signal-to-noise ratio value (or the ratio of bit energy to noise power).
+     * @param outputSignal is a buffer of inputSignal.size() noised samples.
+     */
+    void addGaussianNoise(std::span<const std::complex<double> > inputSignal, double SNR,
+                          std::span<std::complex<double> > outputSignal)
     {
-        std::vector<std::complex<O> > outputData;
-        for (int i = 0; i < inputData.size(); i++)
-            outputData.push_back( std::complex<O>( inputData[i].real(), inputData[i].imag() ) );
-        return outputData;
+        std::copy(inputSignal.begin(), inputSignal.end(), outputSignal.begin());
+        addGaussianNoise(outputSignal.data(), inputSignal.size(), SNR);
     }
 
 
 
+private:
+
+
+    NoiseGenerator      noise_;
+    FadingChannel       fading_;
+    std::vector<double> unitNoise_;
+    std::vector<double> gainRe_;
+    std::vector<double> gainIm_;
+
+
+
 };
 
 
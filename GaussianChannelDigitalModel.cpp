@@ -2,14 +2,87 @@
 #include "QAMdemodulator.h"
 #include "GaussianChannel.h"
 #include "Instruments.h"
+#include "PayloadSource.h"
+#include "Profiler.h"
+#include "ResultStore.h"
+#include "SweepEngine.h"
+#include "SweepOptions.h"
+#include "SweepServer.h"
+#include "TheoreticalBER.h"
 
 
-int main() {
+#if GAUSSIAN_CHANNEL_PROFILE
+// Every allocation of the program is counted in the profile.
+#include "AllocationCounter.h"
+#endif
+
+
+int main(int argc, char* argv[]) {
     // Initialize parameters to work with.
     std::vector<double> SNR = { -2, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
     std::vector<int>    modulationOrders = { 4, 16, 64 };
     Instruments InstrumentsObj;
 
+    // Options: --threads=N (0 is one per core, 1 is serial), --seed=S, --trials=N,
+    // --noise=philox|standard, --fused=0 (run stages one after another),
+    // --adaptive (stop every point at --target-errors=N errors or --max-bits=N bits),
+    // --importance-sampling (=check also runs plain Monte Carlo and compares),
+    // --input=PATH (whole file, memory-mapped), --input=prbs|random with
+    // --payload-bits=N (synthetic data, no file), --common-noise (one noise
+    // sequence per trial for all SNR values, =orders also for all orders), --progress=SECONDS (period of
+    // the progress line, 0 disables it), --profile=PATH (JSON profile of stages),
+    // --resume=PATH (keep finished points in a result store and skip them on
+    // the next run, records are also exported to --export-csv=PATH),
+    // --shard=I/N (run only shard I of N, partial counts go to the result
+    // store, ./BERshardI.bin by default; GaussianChannelMerge combines them),
+    // --fading=rayleigh|rician (with --rician-k=K, --fading-block=N symbols
+    // per gain and --equalizer=zf|mmse, see FadingChannel), --code=hard|soft
+    // (K=7 rate 1/2 convolutional code and Viterbi decoder, SNR is per data bit),
+    // --pulse-shaping (RRC filters with --rolloff=R, --span=SYMBOLS,
+    // --oversampling=N and --filter=fft|direct, see PulseShaper),
+    // --precision=float|double (samples of the fused chain, =check runs in
+    // float and compares with double), --pipelined (stages of a trial on
+    // their own threads, for a few long trials, see AsyncPipeline; queue
+    // occupancy goes to --profile), --hybrid (BER of every point from
+    // TheoreticalBER, Monte Carlo only for points of --simulate=ORDER@SNR,...
+    // or =all, which are compared with theory; all points are simulated
+    // with code, fading or pulse shaping), --orders=4,16,... and
+    // --snr=-2,0,... (grid instead of the one above), --serve[=PATH] (run
+    // sweeps of GaussianChannelClient on a Unix domain socket,
+    // ./GaussianChannel.sock by default, see SweepServer), --adc=BITS
+    // (quantized int16 receiver with --adc-full-scale=X and --agc=0|1, see
+    // AdcQuantizer), --adc-curves=0,4,6,8 (BER of every resolution on the
+    // same noise to ./BERadc.csv, 0 is no ADC).
+    std::map<std::string, std::string> options = InstrumentsObj.parseArguments( argc, argv );
+    SweepParameters parameters;
+    parameters.SNR              = SNR;
+    parameters.modulationOrders = modulationOrders;
+    try {
+        SweepOptions::parse( options, parameters );
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
+    SNR              = parameters.SNR;
+    modulationOrders = parameters.modulationOrders;
+    if (parameters.shardCount > 1) {
+        if (!options.count( "resume" ))
+            options["resume"] = "./BERshard" + std::to_string( parameters.shardIndex ) + ".bin";
+        if (!options.count( "export-csv" ))
+            options["export-csv"] = "./BERshard" + std::to_string( parameters.shardIndex ) + ".csv";
+    }
+    bool hybrid = !parameters.simulated.empty();
+    unsigned nThreads = options.count( "threads" ) ? std::stoul( options["threads"] ) : 0;
+
+    // Server mode: sweeps come from clients, the grid above is the default
+    // of every job.
+    if (options.count( "serve" )) {
+        SweepServer SweepServerObj( options["serve"] == "1" ? "./GaussianChannel.sock" : options["serve"], nThreads, parameters,
+                                    options );
+        return SweepServerObj.run();
+    }
+
     // Write to file parameters (required to plot BER).
     std::vector<double> BER;
     for (double i : SNR)
@@ -19,59 +92,129 @@ int main() {
         BER.push_back(i);
     BER.push_back(-1);
 
-    // Choose data to test system.
-    std::string pathToFile = "./Data.txt";
-    // Use line below and comment line above to work from terminal.
-    // std::string pathToFile = getInputWithDefault( "Enter path to the file:", "/Users/theendru/Desktop/GaussianChannelDigitalModelConsoleApp/Data.txt");
-
-    // Read file.
-    std::string inputText = InstrumentsObj.readFile( pathToFile );
-
-    // Make data binary.
-    std::vector<int> inputTextBinary = InstrumentsObj.stringToBinary( inputText );
-
-    // Initialize required objects of three developed class.
-    qamModulator    QAMmodulatorObj;
-    GaussianChannel GaussianChannelObj;
-    qamDemodulator  QAMdemodulatorObj;
-
-    // Start experiments.
-    for (int k = 0; k < modulationOrders.size(); k++) {
-
-        // Set modulation order.
-        QAMmodulatorObj.setModulationOrder( modulationOrders[k] );
-        GaussianChannelObj.setModulationOrder( modulationOrders[k] );
-        QAMdemodulatorObj.setModulationOrder( modulationOrders[k] );
-
-        // Modulate data (by Sklar - do Impulse Modulation, or do mapping).
-        std::vector<std::complex<int> > dataModulated = QAMmodulatorObj.modulateData( inputTextBinary );
-
-        for (double i : SNR) {
-
-            // We will accumulate BER while...
-            double tempBER = 0;
-            // ...doing several experiments to provide ensemble averaging (assuming stationarity and ergodicity).
-            int nExperiments = 100;
-            for (int j = 0; j < nExperiments; j++) {
+    // Start experiments. Every (order, SNR, trial) is a separate work item.
+    SweepEngine SweepEngineObj( nThreads );
+    std::vector<SweepPoint> points;
+    // Same input for the check below.
+    std::function<std::vector<SweepPoint>(const SweepParameters&, ResultStore*)> runSweep;
+    // Histogram of codes of the input for theory of the hybrid mode.
+    std::function<std::vector<double>(int)> codeProbabilities;
+
+    if (options.count( "input" )) {
+        // Large or binary data goes through without expanding it in memory.
+        std::uint64_t nPayloadBits = options.count( "payload-bits" ) ? std::stoull( options["payload-bits"] ) : 1000000;
+        std::string   input        = options["input"];
+        PayloadSource payload = input == "prbs"   ? PayloadSource::prbs( nPayloadBits )
+                              : input == "random" ? PayloadSource::random( nPayloadBits, parameters.seed )
+                                                  : PayloadSource::fromFile( input );
+        runSweep = [&SweepEngineObj, payload](const SweepParameters& p, ResultStore* store) {
+            return SweepEngineObj.run( p, payload, store );
+        };
+        codeProbabilities = [payload](int modulationOrder) {
+            return TheoreticalBER::codeProbabilities( payload, modulationOrder );
+        };
+    }
+    else {
+        // Choose data to test system.
+        std::string pathToFile = "./Data.txt";
+        // Use line below and comment line above to work from terminal.
+        // std::string pathToFile = getInputWithDefault( "Enter path to the file:", "/Users/theendru/Desktop/GaussianChannelDigitalModelConsoleApp/Data.txt");
+
+        // Read file.
+        std::string inputText = InstrumentsObj.readFile( pathToFile );
+
+        // Make data binary.
+        BitStream inputTextBinary = InstrumentsObj.stringToBinary( inputText );
+        runSweep = [&SweepEngineObj, inputTextBinary](const SweepParameters& p, ResultStore* store) {
+            return SweepEngineObj.run( p, inputTextBinary, store );
+        };
+        codeProbabilities = [inputTextBinary](int modulationOrder) {
+            return TheoreticalBER::codeProbabilities( inputTextBinary, modulationOrder );
+        };
+    }
+    std::unique_ptr<ResultStore> store;
+    if (options.count( "resume" ))
+        store = std::make_unique<ResultStore>( options["resume"] == "1" ? "./BERresults.bin" : options["resume"] );
+    auto start = std::chrono::steady_clock::now();
+    {
+        ProgressReporter progress( options.count( "progress" ) ? std::stod( options["progress"] ) : 1 );
+        points = runSweep( parameters, store.get() );
+    }
 
-                // Add WGN to signal.
-                std::vector<std::complex<double> > dataNoised = GaussianChannelObj.addGaussianNoise( dataModulated, i );
+    // Compare simulated points with points of a reference sweep: difference
+    // in units of combined standard error (about 2 at 95% confidence).
+    auto printDeviations = [&](const std::vector<SweepPoint>& referencePoints, const std::string& names) {
+        std::cout << "order SNR " << names << " deviation" << std::endl;
+        for (std::size_t i = 0; i < points.size(); i++) {
+            if (points[i].bits == 0)
+                continue;
+            double error = (referencePoints[i].upper - referencePoints[i].lower + points[i].upper - points[i].lower) / 2 / parameters.confidenceZ;
+            std::cout << points[i].modulationOrder << ' ' << points[i].SNR << ' ' << referencePoints[i].BER << ' '
+                      << points[i].BER << ' ' << (error > 0 ? (points[i].BER - referencePoints[i].BER) / error : 0) << std::endl;
+        }
+    };
 
-                // Demodulate data (do demapping).
-                std::vector<int> dataDemodulated = QAMdemodulatorObj.demodulateData( dataNoised, modulationOrders[k] );
+    // Validate importance sampling against plain estimator.
+    if (options.count( "importance-sampling" ) && options["importance-sampling"] == "check") {
+        SweepParameters plainParameters = parameters;
+        plainParameters.importanceSampling = false;
+        printDeviations( runSweep( plainParameters, nullptr ), "plainBER importanceBER" );
+    }
 
-                tempBER += InstrumentsObj.computeBER( inputTextBinary, dataDemodulated );
+    // Validate single precision against double precision.
+    if (options.count( "precision" ) && options["precision"] == "check") {
+        SweepParameters doubleParameters = parameters;
+        doubleParameters.precision = FusedPipeline::DOUBLE;
+        printDeviations( runSweep( doubleParameters, nullptr ), "doubleBER floatBER" );
+    }
 
-            }
+    // Curves of BER against ADC resolution, all on the same noise: one
+    // sweep per resolution, zero is the chain without ADC.
+    if (options.count( "adc-curves" )) {
+        std::vector<int>                        resolutions;
+        std::vector<std::vector<SweepPoint> >   curves;
+        for (double bits : SweepOptions::parseList( options["adc-curves"] )) {
+            SweepParameters adcParameters = parameters;
+            adcParameters.adc.bits = int( bits );
+            adcParameters.simulated.clear();
+            resolutions.push_back( adcParameters.adc.bits );
+            curves.push_back( runSweep( adcParameters, nullptr ) );
+        }
+        InstrumentsObj.writeAdcFile( "./BERadc.csv", resolutions, curves );
+    }
 
-            // Averaging BER.
-            BER.push_back( tempBER / nExperiments );
+    // Hybrid mode: simulated points are checked against theory (exact for
+    // the symbol histogram of the input, so it has no error of its own),
+    // other points take it.
+    if (hybrid) {
+        std::vector<SweepPoint>            theoryPoints = points;
+        std::map<int, std::vector<double>> probabilities;
+        for (int order : parameters.modulationOrders)
+            probabilities[ order ] = codeProbabilities( order );
+        for (SweepPoint& i : theoryPoints)
+            i.BER = i.lower = i.upper = TheoreticalBER::bitErrorRate( i.modulationOrder, i.SNR,
+                                                                      probabilities[ i.modulationOrder ] );
+        printDeviations( theoryPoints, "theoryBER simulatedBER" );
+        for (std::size_t i = 0; i < points.size(); i++)
+            if (points[i].bits == 0)
+                points[i].BER = points[i].lower = points[i].upper = theoryPoints[i].BER;
+    }
+    for (const SweepPoint& i : points)
+        BER.push_back( i.BER );
 
-        }
+    if (options.count( "profile" )) {
+        double wallSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        Profiler::writeReport( options["profile"] == "1" ? "./BERprofile.json" : options["profile"], wallSeconds );
     }
 
-    // Write results in file.
-    InstrumentsObj.writeFile( "./BERdata.csv", BER );
+    // Write results in file. A shard has only partial counts, they are
+    // in its result store.
+    if (parameters.shardCount <= 1) {
+        InstrumentsObj.writeFile( "./BERdata.csv", BER );
+        InstrumentsObj.writeConfidenceFile( "./BERconfidence.csv", points );
+    }
+    if (store)
+        store->writeCsv( options.count( "export-csv" ) ? options["export-csv"] : "./BERresults.csv" );
 
     return 1;
 }
\ No newline at end of file
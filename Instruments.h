@@ -2,8 +2,17 @@
 //
 // Created by Konstantin Terentev on 05.09.2024 for YADRO.
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BitStream.h"
 
 #ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_INSTRUMENTS_H
 #define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_INSTRUMENTS_H
@@ -55,16 +64,21 @@ public:
      * Convert string data to binary.
      *
      * @param input is a text information.
-     * @return binary data in int type. From MSB to LSB.
+     * @return packed binary data. From MSB to LSB of every byte.
      */
-    std::vector<int> stringToBinary(const std::string& input) {
-        std::vector<int> output;
-        for (char c : input) {
-            for (int i = 7; i >= 0; i--) {
-                bool bit = (c >> i) & 1;
-                output.push_back(bit ? 1 : 0);
-            }
+    BitStream stringToBinary(const std::string& input) {
+        BitStream output;
+        output.reserve(8 * input.size());
+        std::size_t i = 0;
+        // Eight bytes form one word.
+        for (; i + 8 <= input.size(); i += 8) {
+            std::uint64_t word = 0;
+            for (std::size_t j = 0; j < 8; j++)
+                word = word << 8 | static_cast<unsigned char>(input[i + j]);
+            output.append(word, 64);
         }
+        for (; i < input.size(); i++)
+            output.append(static_cast<unsigned char>(input[i]), 8);
         return output;
     }
 
@@ -73,42 +87,125 @@ public:
     /**
      * Convert binary data to string. Written to output data in terminal.
      *
-     * @param input is a vector of binary data in int type. From MSB to LSB.
-     * @return text data.
+     * @param input is a packed binary data. From MSB to LSB of every byte.
+     * @return text data. Incomplete last byte is dropped.
      */
-    std::string binaryToString(const std::vector<int>& input) {
+    std::string binaryToString(const BitStream& input) {
         std::string output;
-        int decimalValue  =  0;
-        int power         =  7;
-        for (int i = 0; i < input.size(); i++) {
-            decimalValue += input[i] * pow(2, power);
-            power--;
-            if (i % 8 == 7) {
-                output += static_cast<char>( decimalValue );
-                decimalValue  =  0;
-                power         =  7;
-            }
-        }
+        for (std::size_t i = 0; i + 8 <= input.size(); i += 8)
+            output += static_cast<char>( input.read(i, 8) );
         return output;
     }
 
 
 
     /**
-     * Calculate Bit Error Rate (BER). If input is vector of
-     * decimal numbers it is calculating Symbol Error Rate (SER).
+     * Calculate Bit Error Rate (BER) by XOR and popcount of whole words.
      *
-     * @param input1 first vector of data in int type to be
-     * compared.
-     * @param input2 second vector of data in int type to be
-     * compared.
+     * @param input1 is a transmitted data. All its bits are compared.
+     * @param input2 is a received data. It may be longer than input1
+     * (padding of the last symbol), missing bits count as errors.
      * @return value of BER.
      */
-    double computeBER(const std::vector<int>& input1, const std::vector<int>& input2) {
-        double BER = 0;
-        for (int i = 0; i < input1.size(); i++)
-            (input1[i] == input2[i]) ? (BER = BER) : (BER++);
-        return BER / (double)input1.size();
+    double computeBER(const BitStream& input1, const BitStream& input2) {
+        if (input1.empty())
+            return 0;
+        return input1.countDifferences(input2, input1.size()) / (double)input1.size();
+    }
+
+
+
+    /**
+     * Calculate Wilson score confidence interval of error probability.
+     * Unlike normal approximation it stays inside [0, 1] and gives a
+     * nonzero upper bound when there are no errors.
+     *
+     * @param errors is a number of errors.
+     * @param bits is a number of tested bits.
+     * @param z is a quantile of standard normal distribution (1.96 for 95%).
+     * @return lower and upper bounds.
+     */
+    std::pair<double, double> computeConfidenceInterval(std::uint64_t errors, std::uint64_t bits, double z) {
+        if (bits == 0)
+            return { 0, 1 };
+        double n      = bits;
+        double p      = errors / n;
+        double center = (p + z * z / (2 * n)) / (1 + z * z / n);
+        double half   = z / (1 + z * z / n) * sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+        return { std::max(0.0, center - half), std::min(1.0, center + half) };
+    }
+
+
+
+    /**
+     * Write sweep results with confidence intervals, one point per line.
+     *
+     * @param pathToFile is a path to the file in text (string) format.
+     * @param points is a vector of (order, SNR) points. Every point has fields
+     * modulationOrder, SNR, BER, lower, upper, errors, bits and trials.
+     */
+    template <typename Point>
+    void writeConfidenceFile(const std::string& pathToFile, const std::vector<Point>& points) {
+        std::ofstream out( pathToFile );
+        if (!out.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return;
+        }
+        out << "order,SNR,BER,lower,upper,errors,bits,trials" << std::endl;
+        for (const Point& i : points)
+            out << i.modulationOrder << ',' << i.SNR << ',' << i.BER << ',' << i.lower << ',' << i.upper << ','
+                << i.errors << ',' << i.bits << ',' << i.trials << std::endl;
+    }
+
+
+
+    /**
+     * Write sweep results of several ADC resolutions, one point per line.
+     *
+     * @param pathToFile is a path to the file in text (string) format.
+     * @param resolutions is a vector of ADC bits of every sweep (0 is no ADC).
+     * @param curves is a vector of points of every sweep (see writeConfidenceFile).
+     */
+    template <typename Point>
+    void writeAdcFile(const std::string& pathToFile, const std::vector<int>& resolutions,
+                      const std::vector<std::vector<Point> >& curves) {
+        std::ofstream out( pathToFile );
+        if (!out.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return;
+        }
+        out << "adc_bits,order,SNR,BER,lower,upper,errors,bits,trials" << std::endl;
+        for (std::size_t k = 0; k < curves.size(); k++)
+            for (const Point& i : curves[k])
+                out << resolutions[k] << ',' << i.modulationOrder << ',' << i.SNR << ',' << i.BER << ',' << i.lower << ','
+                    << i.upper << ',' << i.errors << ',' << i.bits << ',' << i.trials << std::endl;
+    }
+
+
+
+    /**
+     * Parse command line options of "--key=value" form. Option
+     * without value ("--key") gets value "1".
+     *
+     * @param argc is a number of arguments passed to main.
+     * @param argv is a vector of arguments passed to main.
+     * @return map from option name (without dashes) to its value.
+     */
+    std::map<std::string, std::string> parseArguments(int argc, char* argv[]) {
+        std::map<std::string, std::string> options;
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument.rfind("--", 0) != 0) {
+                std::cerr << "Unknown argument " << argument << " is ignored" << std::endl;
+                continue;
+            }
+            std::size_t position = argument.find('=');
+            if (position == std::string::npos)
+                options[ argument.substr(2) ] = std::string( "1" );
+            else
+                options[ argument.substr(2, position - 2) ] = argument.substr(position + 1);
+        }
+        return options;
     }
 
 
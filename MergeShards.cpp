@@ -0,0 +1,135 @@
+// Merge tool of sharded sweeps. Every shard of a sweep (--shard=I/N of
+// the console app) keeps partial error and bit counts of its trials in a
+// result store. This tool sums counts of all shards point by point and
+// writes BERdata.csv and BERconfidence.csv, the same as a single run of
+// the whole sweep would write.
+//
+// Options: --shards=PATH,PATH,... (result stores of all shards)
+// --configuration=HEX (hash of the sweep, default is the hash of the last
+// record of the first store) --output=DIRECTORY (created if missing,
+// default is ".")
+// --orders=... --snr=... (grid of the sweep as given to the shards, default
+// is orders and SNR in the order their records were first appended, which
+// is the grid order unless the sweep is adaptive).
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "QAMmodulator.h"
+#include "QAMdemodulator.h"
+#include "GaussianChannel.h"
+#include "Instruments.h"
+#include "ResultStore.h"
+#include "SweepEngine.h"
+#include "SweepOptions.h"
+
+
+int main(int argc, char* argv[]) {
+    Instruments InstrumentsObj;
+    std::map<std::string, std::string> options = InstrumentsObj.parseArguments( argc, argv );
+    if (!options.count( "shards" )) {
+        std::cerr << "Usage: GaussianChannelMerge --shards=PATH,PATH,... [--configuration=HEX] [--output=DIRECTORY] "
+                     "[--orders=...] [--snr=...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> paths;
+    std::stringstream list( options["shards"] );
+    for (std::string path; std::getline( list, path, ',' ); )
+        paths.push_back( path );
+    std::string directory = options.count( "output" ) ? options["output"] : ".";
+
+    // Sum the latest record of every point of every shard.
+    std::uint64_t configurationHash = options.count( "configuration" ) ? std::stoull( options["configuration"], nullptr, 16 ) : 0;
+    bool          haveHash          = options.count( "configuration" ) != 0;
+    bool          importanceSampling = false;
+    std::map<std::pair<int, double>, SweepPoint> merged;
+    std::vector<int>    modulationOrders;
+    std::vector<double> SNR;
+    for (const std::string& path : paths) {
+        ResultStore store( path, true );
+        const std::vector<ResultStore::Record>& records = store.getRecords();
+        if (!haveHash && !records.empty()) {
+            configurationHash = records.back().configurationHash;
+            haveHash = true;
+        }
+        std::map<std::pair<int, double>, const ResultStore::Record*> latest;
+        for (const ResultStore::Record& record : records) {
+            if (record.configurationHash != configurationHash)
+                continue;
+            latest[ { record.modulationOrder, record.SNR } ] = &record;
+            if (std::find( modulationOrders.begin(), modulationOrders.end(), record.modulationOrder ) == modulationOrders.end())
+                modulationOrders.push_back( record.modulationOrder );
+            if (std::find( SNR.begin(), SNR.end(), record.SNR ) == SNR.end())
+                SNR.push_back( record.SNR );
+        }
+        if (latest.empty())
+            std::cerr << "Store " << path << " has no records of the sweep" << std::endl;
+        for (const auto& [key, record] : latest) {
+            SweepPoint& p = merged[ key ];
+            p.modulationOrder        = record->modulationOrder;
+            p.SNR                    = record->SNR;
+            p.errors                += record->errors;
+            p.bits                  += record->bits;
+            p.trials                += record->trials;
+            p.weightedErrors        += record->weightedErrors;
+            p.weightedErrorsSquared += record->weightedErrorsSquared;
+            importanceSampling       = importanceSampling || (record->flags & ResultStore::IMPORTANCE_SAMPLING);
+        }
+    }
+    if (merged.empty()) {
+        std::cerr << "No records to merge" << std::endl;
+        return 1;
+    }
+
+    // Grid of the sweep: every order by every SNR, SNR is the fastest
+    // changing index (as in the console app).
+    if (options.count( "orders" )) {
+        modulationOrders.clear();
+        for (double i : SweepOptions::parseList( options["orders"] ))
+            modulationOrders.push_back( int( i ) );
+    }
+    if (options.count( "snr" ))
+        SNR = SweepOptions::parseList( options["snr"] );
+
+    SweepParameters parameters;
+    parameters.importanceSampling = importanceSampling;
+    std::vector<SweepPoint> points;
+    std::vector<double>     BER( SNR.begin(), SNR.end() );
+    BER.push_back( -1 );
+    BER.insert( BER.end(), modulationOrders.begin(), modulationOrders.end() );
+    BER.push_back( -1 );
+    for (int order : modulationOrders)
+        for (double snr : SNR) {
+            auto found = merged.find( { order, snr } );
+            SweepPoint p;
+            if (found == merged.end()) {
+                std::cerr << "Point " << order << ", " << snr << " has no records" << std::endl;
+                p.modulationOrder = order;
+                p.SNR             = snr;
+            }
+            else
+                p = found->second;
+            SweepEngine::estimate( parameters, p );
+            points.push_back( p );
+            BER.push_back( p.BER );
+        }
+
+    std::error_code error;
+    std::filesystem::create_directories( directory, error );
+    if (error) {
+        std::cerr << "Cannot create output directory " << directory << ": " << error.message() << std::endl;
+        return 1;
+    }
+    InstrumentsObj.writeFile( directory + "/BERdata.csv", BER );
+    InstrumentsObj.writeConfidenceFile( directory + "/BERconfidence.csv", points );
+    std::cout << "Merged " << paths.size() << " shards, " << points.size() << " points of sweep "
+              << std::hex << configurationHash << std::dec << std::endl;
+    return 0;
+}
@@ -0,0 +1,501 @@
+// This class generates standard normal samples for the channel. The
+// source is chosen at runtime: either std::mt19937_64 with
+// std::normal_distribution, or the counter-based Philox4x32-10 generator
+// followed by a batched Box-Muller transform. Philox output is a pure
+// function of (seed, stream, sample index), so the same samples come out
+// however the buffer is split into calls, and the Box-Muller loop uses
+// only arithmetic (no libm calls) so the compiler can run it in
+// AVX2/AVX-512 lanes. Single precision samples take one Philox call per
+// four samples and float arithmetic, twice the lanes of double.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Profiler.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_NOISEGENERATOR_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_NOISEGENERATOR_H
+
+
+class NoiseGenerator {
+public:
+
+
+    enum Source {
+        STANDARD,   // std::mt19937_64 + std::normal_distribution.
+        PHILOX      // Philox4x32-10 + vectorized Box-Muller.
+    };
+
+
+    NoiseGenerator()
+    {
+        std::random_device seed;
+        setSeed( (std::uint64_t(seed()) << 32) | seed() );
+    }
+
+
+    /**
+     * Convert source name ("standard" or "philox") to source.
+     *
+     * @param name is a name of the source.
+     * @return source.
+     * @throws std::invalid_argument if name is unknown.
+     */
+    static Source parseSource(const std::string& name)
+    {
+        if (name == "standard")
+            return STANDARD;
+        if (name != "philox")
+            throw std::invalid_argument( "Unknown noise source " + name + ", it must be philox or standard" );
+        return PHILOX;
+    }
+
+
+    // Chooses source of samples. Call setSeed afterwards to restart it.
+    void setSource(Source source)
+    {
+        source_ = source;
+    }
+
+
+    // Returns source of samples.
+    Source getSource() const
+    {
+        return source_;
+    }
+
+
+    /**
+     * Restart generator at the first sample of a given stream.
+     *
+     * @param seed is a key of the generator.
+     * @param stream is an identifier of an independent sequence
+     * under the same key.
+     */
+    void setSeed(std::uint64_t seed, std::uint64_t stream = 0)
+    {
+        seed_     = seed;
+        stream_   = stream;
+        position_ = 0;
+        SeedSequence sequence{ { std::uint32_t(seed), std::uint32_t(seed >> 32),
+                                 std::uint32_t(stream), std::uint32_t(stream >> 32) } };
+        engine_.seed( sequence );
+        normal_.reset();
+    }
+
+
+    /**
+     * Write next standard normal samples.
+     *
+     * @param output is a buffer of at least n values.
+     * @param n is a number of samples.
+     */
+    void fillGaussian(double* output, std::size_t n)
+    {
+        Profiler::addRandomDraws( n );
+        if (source_ == STANDARD) {
+            for (std::size_t i = 0; i < n; i++)
+                output[i] = normal_( engine_ );
+            return;
+        }
+        // Samples go in pairs, one Philox call per pair. A call that
+        // starts or ends in the middle of a pair recomputes that pair.
+        double pair[2];
+        if (n > 0 && position_ % 2 == 1) {
+            generatePairs( position_ / 2, 1, pair );
+            *output++ = pair[1];
+            position_++;
+            n--;
+        }
+        std::size_t nPairs = n / 2;
+        generatePairs( position_ / 2, nPairs, output );
+        position_ += 2 * nPairs;
+        if (n % 2 == 1) {
+            generatePairs( position_ / 2, 1, pair );
+            output[ 2 * nPairs ] = pair[0];
+            position_++;
+        }
+    }
+
+
+    /**
+     * Write next standard normal samples in single precision. Four samples
+     * come from one Philox call (two per call in double precision), so they
+     * differ from the double samples of the same stream. Radius of a pair
+     * is limited to 7.4 (8.5 in double precision). A generator should be
+     * used in one precision after setSeed, both share the position.
+     *
+     * @param output is a buffer of at least n values.
+     * @param n is a number of samples.
+     */
+    void fillGaussian(float* output, std::size_t n)
+    {
+        Profiler::addRandomDraws( n );
+        if (source_ == STANDARD) {
+            for (std::size_t i = 0; i < n; i++)
+                output[i] = float( normal_( engine_ ) );
+            return;
+        }
+        // Same as above with quads: a call that starts or ends in the
+        // middle of a quad recomputes that quad.
+        float quad[4];
+        while (n > 0 && position_ % 4 != 0) {
+            generateQuads( position_ / 4, 1, quad );
+            *output++ = quad[ position_ % 4 ];
+            position_++;
+            n--;
+        }
+        std::size_t nQuads = n / 4;
+        generateQuads( position_ / 4, nQuads, output );
+        position_ += 4 * nQuads;
+        if (n % 4 != 0) {
+            generateQuads( position_ / 4, 1, quad );
+            for (std::size_t i = 0; i < n % 4; i++)
+                output[ 4 * nQuads + i ] = quad[i];
+            position_ += n % 4;
+        }
+    }
+
+
+    /**
+     * Uniform random bits attached to an index of the current stream,
+     * independent of the normal samples (SplitMix64 of seed, stream and index).
+     *
+     * @param index is an index of the sample the bits belong to.
+     * @return 64 random bits.
+     */
+    std::uint64_t randomBits(std::uint64_t index) const
+    {
+        std::uint64_t x = seed_ ^ 0x6A09E667F3BCC909ull;
+        for (std::uint64_t i : { stream_, index }) {
+            x += 0x9E3779B97F4A7C15ull + i;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            x =  x ^ (x >> 31);
+        }
+        return x;
+    }
+
+
+    /**
+     * Add zero mean normal samples to data.
+     *
+     * @param data is a buffer of n values to add noise to.
+     * @param n is a number of values.
+     * @param sigma is a standard deviation of noise.
+     */
+    void addGaussian(double* data, std::size_t n, double sigma)
+    {
+        buffer_.resize( BUFFER_SIZE );
+        for (std::size_t begin = 0; begin < n; begin += BUFFER_SIZE) {
+            std::size_t count = std::min( BUFFER_SIZE, n - begin );
+            fillGaussian( buffer_.data(), count );
+            double* chunk = data + begin;
+            const double* noise = buffer_.data();
+            #pragma omp simd
+            for (std::size_t i = 0; i < count; i++)
+                chunk[i] += sigma * noise[i];
+        }
+    }
+
+
+
+    /**
+     * Add zero mean normal samples to data in single precision.
+     *
+     * @param data is a buffer of n values to add noise to.
+     * @param n is a number of values.
+     * @param sigma is a standard deviation of noise.
+     */
+    void addGaussian(float* data, std::size_t n, float sigma)
+    {
+        floatBuffer_.resize( BUFFER_SIZE );
+        for (std::size_t begin = 0; begin < n; begin += BUFFER_SIZE) {
+            std::size_t count = std::min( BUFFER_SIZE, n - begin );
+            fillGaussian( floatBuffer_.data(), count );
+            float* chunk = data + begin;
+            const float* noise = floatBuffer_.data();
+            #pragma omp simd
+            for (std::size_t i = 0; i < count; i++)
+                chunk[i] += sigma * noise[i];
+        }
+    }
+
+
+private:
+
+
+    static constexpr std::size_t BUFFER_SIZE = 4096;
+
+
+    // std::seed_seq of four values without its heap copy of them: generate
+    // is the algorithm of the standard, so engines get the same state.
+    struct SeedSequence {
+        using result_type = std::uint32_t;
+
+        std::uint32_t values[4];
+
+        template <typename Iterator>
+        void generate(Iterator begin, Iterator end) const
+        {
+            std::size_t n = end - begin;
+            if (n == 0)
+                return;
+            std::fill( begin, end, 0x8b8b8b8bu );
+            const std::size_t s = 4;
+            std::size_t t = n >= 623 ? 11 : n >= 68 ? 7 : n >= 39 ? 5 : n >= 7 ? 3 : (n - 1) / 2;
+            std::size_t p = (n - t) / 2;
+            std::size_t q = p + t;
+            std::size_t m = std::max( s + 1, n );
+            auto T = [](std::uint32_t x) { return x ^ (x >> 27); };
+            auto b = [&](std::size_t k) -> auto& { return begin[ k % n ]; };
+            for (std::size_t k = 0; k < m; k++) {
+                std::uint32_t r1 = 1664525u * T( std::uint32_t( b( k ) ^ b( k + p ) ^ b( k + n - 1 ) ) );
+                std::uint32_t r2 = r1 + std::uint32_t( k == 0 ? s : k <= s ? k % n + values[ k - 1 ] : k % n );
+                b( k + p ) = std::uint32_t( b( k + p ) + r1 );
+                b( k + q ) = std::uint32_t( b( k + q ) + r2 );
+                b( k )     = r2;
+            }
+            for (std::size_t k = m; k < m + n; k++) {
+                std::uint32_t r3 = 1566083941u * T( std::uint32_t( b( k ) + b( k + p ) + b( k + n - 1 ) ) );
+                std::uint32_t r4 = r3 - std::uint32_t( k % n );
+                b( k + p ) = std::uint32_t( b( k + p ) ^ r3 );
+                b( k + q ) = std::uint32_t( b( k + q ) ^ r4 );
+                b( k )     = r4;
+            }
+        }
+    };
+
+
+    /**
+     * Philox4x32-10 block followed by Box-Muller transform. Pair p of the
+     * stream uses counter (p, stream) under key seed.
+     *
+     * @param firstPair is an index of the first pair in the stream.
+     * @param nPairs is a number of pairs to generate.
+     * @param output is a buffer of 2*nPairs samples.
+     */
+    void generatePairs(std::uint64_t firstPair, std::size_t nPairs, double* output) const
+    {
+        const std::uint32_t key0 = std::uint32_t( seed_ );
+        const std::uint32_t key1 = std::uint32_t( seed_ >> 32 );
+        const std::uint32_t c2   = std::uint32_t( stream_ );
+        const std::uint32_t c3   = std::uint32_t( stream_ >> 32 );
+        #pragma omp simd
+        for (std::size_t p = 0; p < nPairs; p++) {
+            std::uint64_t counter = firstPair + p;
+            std::uint32_t x0 = std::uint32_t( counter );
+            std::uint32_t x1 = std::uint32_t( counter >> 32 );
+            std::uint32_t x2 = c2;
+            std::uint32_t x3 = c3;
+            philox( x0, x1, x2, x3, key0, key1 );
+            // Two 52-bit uniforms u1 in (0, 1] and u2 in [0, 1), made by
+            // filling mantissa of a double in [1, 2).
+            double u1 = 2.0 - std::bit_cast<double>( (std::uint64_t( x1 ) << 32 | x0) >> 12 | 0x3FF0000000000000ull );
+            double u2 = std::bit_cast<double>( (std::uint64_t( x3 ) << 32 | x2) >> 12 | 0x3FF0000000000000ull ) - 1.0;
+            double radius = std::sqrt( -2.0 * logUnit( u1 ) );
+            double c, s;
+            sinCosTurn( u2, c, s );
+            output[ 2 * p ]     = radius * c;
+            output[ 2 * p + 1 ] = radius * s;
+        }
+    }
+
+
+    /**
+     * Philox4x32-10 block followed by Box-Muller transform in single
+     * precision. Quad q of the stream uses counter (q, stream) under key
+     * seed, every half of the block gives a pair: 40 bits for the radius
+     * and 24 bits for the angle.
+     *
+     * @param firstQuad is an index of the first quad in the stream.
+     * @param nQuads is a number of quads to generate.
+     * @param output is a buffer of 4*nQuads samples.
+     */
+    void generateQuads(std::uint64_t firstQuad, std::size_t nQuads, float* output) const
+    {
+        const std::uint32_t key0 = std::uint32_t( seed_ );
+        const std::uint32_t key1 = std::uint32_t( seed_ >> 32 );
+        const std::uint32_t c2   = std::uint32_t( stream_ );
+        const std::uint32_t c3   = std::uint32_t( stream_ >> 32 );
+        #pragma omp simd
+        for (std::size_t q = 0; q < nQuads; q++) {
+            std::uint64_t counter = firstQuad + q;
+            std::uint32_t x0 = std::uint32_t( counter );
+            std::uint32_t x1 = std::uint32_t( counter >> 32 );
+            std::uint32_t x2 = c2;
+            std::uint32_t x3 = c3;
+            philox( x0, x1, x2, x3, key0, key1 );
+            boxMuller( x0, x1, output[ 4 * q ], output[ 4 * q + 1 ] );
+            boxMuller( x2, x3, output[ 4 * q + 2 ], output[ 4 * q + 3 ] );
+        }
+    }
+
+
+    // Ten rounds of Philox4x32 on counter (x0, x1, x2, x3) under key (k0, k1).
+    static void philox(std::uint32_t& x0, std::uint32_t& x1, std::uint32_t& x2, std::uint32_t& x3,
+                       std::uint32_t k0, std::uint32_t k1)
+    {
+        for (int round = 0; round < 10; round++) {
+            std::uint64_t product0 = std::uint64_t( 0xD2511F53u ) * x0;
+            std::uint64_t product1 = std::uint64_t( 0xCD9E8D57u ) * x2;
+            std::uint32_t y0 = std::uint32_t( product1 >> 32 ) ^ x1 ^ k0;
+            std::uint32_t y2 = std::uint32_t( product0 >> 32 ) ^ x3 ^ k1;
+            x1 = std::uint32_t( product1 );
+            x3 = std::uint32_t( product0 );
+            x0 = y0;
+            x2 = y2;
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+    }
+
+
+    // Pair of normal samples in single precision from 64 random bits.
+    static void boxMuller(std::uint32_t high, std::uint32_t low, float& first, float& second)
+    {
+        // u1 = (a + 1) / 2^40 in (0, 1] of the 40-bit a made of high and the
+        // top byte of low, as a sum of two floats which are exact;
+        // u2 in [0, 1) of the other 24 bits.
+        float u1 = (float( std::int32_t( high >> 8 ) )
+                    + float( std::int32_t( (high & 0xFF) << 8 | low >> 24 ) + 1 ) * 0x1p-16f) * 0x1p-24f;
+        float u2 = float( std::int32_t( low & 0xFFFFFF ) ) * 0x1p-24f;
+        float radius = std::sqrt( -2.0f * logUnit( u1 ) );
+        float c, s;
+        sinCosTurn( u2, c, s );
+        first  = radius * c;
+        second = radius * s;
+    }
+
+
+    // Natural logarithm for x in (0, 1]. Shifts the bits so that the
+    // mantissa falls into [sqrt(2)/2, sqrt(2)) (the same trick as in
+    // musl log) and evaluates atanh series of it. No branches or selects.
+    static double logUnit(double x)
+    {
+        std::uint64_t bits = std::bit_cast<std::uint64_t>( x ) + (0x3FF0000000000000ull - 0x3FE6A09E667F3BCDull);
+        // Exponent as double without int-to-double conversion.
+        double exponent = std::bit_cast<double>( (bits >> 52) | 0x4330000000000000ull ) - 0x1p52 - 1023.0;
+        double mantissa = std::bit_cast<double>( (bits & 0x000FFFFFFFFFFFFFull) + 0x3FE6A09E667F3BCDull );
+        double s  = (mantissa - 1.0) / (mantissa + 1.0);
+        double s2 = s * s;
+        double series = 1.0 / 17;
+        series = series * s2 + 1.0 / 15;
+        series = series * s2 + 1.0 / 13;
+        series = series * s2 + 1.0 / 11;
+        series = series * s2 + 1.0 / 9;
+        series = series * s2 + 1.0 / 7;
+        series = series * s2 + 1.0 / 5;
+        series = series * s2 + 1.0 / 3;
+        series = series * s2 + 1.0;
+        return exponent * 0.6931471805599453 + 2.0 * s * series;
+    }
+
+
+    // Cosine and sine of 2*pi*t for t in [0, 1). Reduces to a quarter
+    // turn and evaluates Taylor polynomials on [-pi/4, pi/4].
+    static void sinCosTurn(double t, double& cosine, double& sine)
+    {
+        // Round 4t to nearest integer without libm; the low bits of the
+        // shifted value are the quadrant.
+        double shifted = 4.0 * t + 0x1.8p52;
+        std::uint64_t quadrant = std::bit_cast<std::uint64_t>( shifted ) & 3;
+        double x  = 6.283185307179586 * (t - 0.25 * (shifted - 0x1.8p52));
+        double x2 = x * x;
+        double s = -1.0 / 1307674368000;
+        s = s * x2 + 1.0 / 6227020800;
+        s = s * x2 - 1.0 / 39916800;
+        s = s * x2 + 1.0 / 362880;
+        s = s * x2 - 1.0 / 5040;
+        s = s * x2 + 1.0 / 120;
+        s = s * x2 - 1.0 / 6;
+        s = x + x * x2 * s;
+        double c = 1.0 / 20922789888000;
+        c = c * x2 - 1.0 / 87178291200;
+        c = c * x2 + 1.0 / 479001600;
+        c = c * x2 - 1.0 / 3628800;
+        c = c * x2 + 1.0 / 40320;
+        c = c * x2 - 1.0 / 720;
+        c = c * x2 + 1.0 / 24;
+        c = c * x2 - 0.5;
+        c = 1.0 + x2 * c;
+        // Rotate by quadrant * pi/2 with bit masks instead of branches.
+        std::uint64_t swap      = 0 - (quadrant & 1);
+        std::uint64_t negCosine = ((quadrant + 1) >> 1 & 1) << 63;
+        std::uint64_t negSine   = (quadrant >> 1) << 63;
+        std::uint64_t cBits = std::bit_cast<std::uint64_t>( c );
+        std::uint64_t sBits = std::bit_cast<std::uint64_t>( s );
+        cosine = std::bit_cast<double>( ((sBits & swap) | (cBits & ~swap)) ^ negCosine );
+        sine   = std::bit_cast<double>( ((cBits & swap) | (sBits & ~swap)) ^ negSine );
+    }
+
+
+    // Single precision logUnit, the series is cut at the float epsilon.
+    static float logUnit(float x)
+    {
+        std::uint32_t bits = std::bit_cast<std::uint32_t>( x ) + (0x3F800000u - 0x3F3504F3u);
+        float exponent = std::bit_cast<float>( (bits >> 23) | 0x4B000000u ) - 0x1p23f - 127.0f;
+        float mantissa = std::bit_cast<float>( (bits & 0x007FFFFFu) + 0x3F3504F3u );
+        float s  = (mantissa - 1.0f) / (mantissa + 1.0f);
+        float s2 = s * s;
+        float series = 1.0f / 11;
+        series = series * s2 + 1.0f / 9;
+        series = series * s2 + 1.0f / 7;
+        series = series * s2 + 1.0f / 5;
+        series = series * s2 + 1.0f / 3;
+        series = series * s2 + 1.0f;
+        return exponent * 0.6931471805599453f + 2.0f * s * series;
+    }
+
+
+    // Single precision sinCosTurn, Taylor polynomials cut at the float epsilon.
+    static void sinCosTurn(float t, float& cosine, float& sine)
+    {
+        float shifted = 4.0f * t + 0x1.8p23f;
+        std::uint32_t quadrant = std::bit_cast<std::uint32_t>( shifted ) & 3;
+        float x  = 6.283185307179586f * (t - 0.25f * (shifted - 0x1.8p23f));
+        float x2 = x * x;
+        float s = 1.0f / 362880;
+        s = s * x2 - 1.0f / 5040;
+        s = s * x2 + 1.0f / 120;
+        s = s * x2 - 1.0f / 6;
+        s = x + x * x2 * s;
+        float c = -1.0f / 3628800;
+        c = c * x2 + 1.0f / 40320;
+        c = c * x2 - 1.0f / 720;
+        c = c * x2 + 1.0f / 24;
+        c = c * x2 - 0.5f;
+        c = 1.0f + x2 * c;
+        std::uint32_t swap      = 0 - (quadrant & 1);
+        std::uint32_t negCosine = ((quadrant + 1) >> 1 & 1) << 31;
+        std::uint32_t negSine   = (quadrant >> 1) << 31;
+        std::uint32_t cBits = std::bit_cast<std::uint32_t>( c );
+        std::uint32_t sBits = std::bit_cast<std::uint32_t>( s );
+        cosine = std::bit_cast<float>( ((sBits & swap) | (cBits & ~swap)) ^ negCosine );
+        sine   = std::bit_cast<float>( ((cBits & swap) | (sBits & ~swap)) ^ negSine );
+    }
+
+
+
+    Source                              source_     = PHILOX;
+    std::uint64_t                       seed_       = 0;
+    std::uint64_t                       stream_     = 0;
+    std::uint64_t                       position_   = 0;
+    std::mt19937_64                     engine_;
+    std::normal_distribution<double>    normal_;
+    std::vector<double>                 buffer_;
+    std::vector<float>                  floatBuffer_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_NOISEGENERATOR_H
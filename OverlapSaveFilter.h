@@ -0,0 +1,295 @@
+// This class is a streaming FIR filter of complex samples with real taps.
+// Long filters go through FFT overlap-save: every block of the FFT size
+// holds the last (taps - 1) input samples and new ones, its spectrum is
+// multiplied by the spectrum of taps and the inverse FFT gives one output
+// per new sample. FFT plans (bit reversal and twiddles) are made once per
+// size and shared by all filters, block buffers are 64-byte aligned and
+// reused between calls. Direct form is kept for short filters and for
+// comparison, both forms give the same output and keep the same state.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numbers>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_OVERLAPSAVEFILTER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_OVERLAPSAVEFILTER_H
+
+
+// Allocator of 64-byte aligned (cache line and AVX-512) buffers.
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>( ::operator new( n * sizeof(T), std::align_val_t( ALIGNMENT ) ) );
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        ::operator delete( p, std::align_val_t( ALIGNMENT ) );
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const
+    {
+        return true;
+    }
+};
+
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+
+// Iterative radix-2 FFT of a fixed size.
+class FFTPlan {
+public:
+
+
+    /**
+     * Plan of a given size, made on first use and cached.
+     *
+     * @param size is a power of two.
+     * @return shared plan.
+     */
+    static std::shared_ptr<const FFTPlan> forSize(std::size_t size)
+    {
+        static std::mutex                                                   mutex;
+        static std::map<std::size_t, std::shared_ptr<const FFTPlan> >     plans;
+        std::lock_guard<std::mutex> lock( mutex );
+        std::shared_ptr<const FFTPlan>& plan = plans[ size ];
+        if (!plan)
+            plan = std::shared_ptr<const FFTPlan>( new FFTPlan( size ) );
+        return plan;
+    }
+
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+
+    /**
+     * Transform in place. Inverse transform is not scaled by 1/size.
+     *
+     * @param data is a buffer of size() values.
+     * @param inverse is true for the inverse transform.
+     */
+    void transform(std::complex<double>* data, bool inverse) const
+    {
+        for (std::size_t i = 0; i < size_; i++)
+            if (i < bitReverse_[i])
+                std::swap( data[i], data[ bitReverse_[i] ] );
+        double* values = reinterpret_cast<double*>( data );
+        double  sign   = inverse ? -1 : 1;
+        // Butterflies of the first stage have no twiddles.
+        for (std::size_t i = 0; i < size_; i += 2) {
+            std::complex<double> a = data[i];
+            data[i]       = a + data[ i + 1 ];
+            data[ i + 1 ] = a - data[ i + 1 ];
+        }
+        // Stage of half length h reads twiddles h - 1 ... 2h - 2 of the table.
+        for (std::size_t half = 2; half < size_; half *= 2) {
+            const double* twiddles = reinterpret_cast<const double*>( twiddles_.data() + half - 1 );
+            for (std::size_t begin = 0; begin < size_; begin += 2 * half) {
+                double* a = values + 2 * begin;
+                double* b = values + 2 * (begin + half);
+                #pragma omp simd
+                for (std::size_t j = 0; j < half; j++) {
+                    double wr = twiddles[ 2 * j ];
+                    double wi = sign * twiddles[ 2 * j + 1 ];
+                    double tr = b[ 2 * j ] * wr - b[ 2 * j + 1 ] * wi;
+                    double ti = b[ 2 * j ] * wi + b[ 2 * j + 1 ] * wr;
+                    b[ 2 * j ]     = a[ 2 * j ] - tr;
+                    b[ 2 * j + 1 ] = a[ 2 * j + 1 ] - ti;
+                    a[ 2 * j ]     += tr;
+                    a[ 2 * j + 1 ] += ti;
+                }
+            }
+        }
+    }
+
+
+
+private:
+
+
+    explicit FFTPlan(std::size_t size)
+        : size_( size ), bitReverse_( size ), twiddles_( size )
+    {
+        int nBits = 0;
+        while ((std::size_t( 1 ) << nBits) < size)
+            nBits++;
+        for (std::size_t i = 0; i < size; i++) {
+            std::size_t reversed = 0;
+            for (int bit = 0; bit < nBits; bit++)
+                reversed |= (i >> bit & 1) << (nBits - 1 - bit);
+            bitReverse_[i] = reversed;
+        }
+        for (std::size_t half = 1; half < size; half *= 2)
+            for (std::size_t j = 0; j < half; j++)
+                twiddles_[ half - 1 + j ] = std::polar( 1.0, -std::numbers::pi * j / half );
+    }
+
+
+
+    std::size_t                                 size_;
+    std::vector<std::size_t>                    bitReverse_;
+    AlignedVector<std::complex<double> >        twiddles_;
+
+
+
+};
+
+
+class OverlapSaveFilter {
+public:
+
+
+    /**
+     * Create filter with a given impulse response and empty history.
+     *
+     * @param taps is a vector of filter coefficients, taps[0] is applied
+     * to the newest sample.
+     */
+    explicit OverlapSaveFilter(const std::vector<double>& taps = { 1.0 })
+        : taps_( taps.empty() ? std::vector<double>{ 1.0 } : taps )
+    {
+        std::size_t nTaps = taps_.size();
+        // About four times the length of taps keeps the share of history
+        // in a block small.
+        std::size_t size = 2;
+        while (size < 4 * nTaps)
+            size *= 2;
+        plan_ = FFTPlan::forSize( size );
+        block_.resize( size );
+        spectrum_.assign( size, 0 );
+        for (std::size_t i = 0; i < nTaps; i++)
+            spectrum_[i] = taps_[i] / double( size );     // With 1/size of the inverse transform.
+        plan_->transform( spectrum_.data(), false );
+        reversedTaps_.assign( taps_.rbegin(), taps_.rend() );
+        reset();
+    }
+
+
+    // Returns number of taps.
+    std::size_t getNumberOfTaps() const
+    {
+        return taps_.size();
+    }
+
+
+    // Clears history: the input before the next sample is zero.
+    void reset()
+    {
+        history_.assign( taps_.size() - 1, 0 );
+    }
+
+
+    /**
+     * Filter next samples with FFT overlap-save.
+     *
+     * @param input is a buffer of n samples.
+     * @param n is a number of samples.
+     * @param output is a buffer of n filtered samples (may be input).
+     */
+    void process(const std::complex<double>* input, std::size_t n, std::complex<double>* output)
+    {
+        std::size_t nHistory = history_.size();
+        std::size_t size     = block_.size();
+        std::size_t step     = size - nHistory;
+        for (std::size_t begin = 0; begin < n; begin += step) {
+            std::size_t count = std::min( step, n - begin );
+            std::copy( history_.begin(), history_.end(), block_.begin() );
+            std::copy( input + begin, input + begin + count, block_.begin() + nHistory );
+            std::fill( block_.begin() + nHistory + count, block_.end(), 0 );
+            // New history is the last samples of the block before it is
+            // transformed (output may overwrite input).
+            std::copy( block_.begin() + count, block_.begin() + count + nHistory, history_.begin() );
+            plan_->transform( block_.data(), false );
+            multiply( block_.data(), spectrum_.data(), size );
+            plan_->transform( block_.data(), true );
+            std::copy( block_.begin() + nHistory, block_.begin() + nHistory + count, output + begin );
+        }
+    }
+
+
+    /**
+     * Filter next samples with direct-form convolution.
+     *
+     * @param input is a buffer of n samples.
+     * @param n is a number of samples.
+     * @param output is a buffer of n filtered samples (may be input).
+     */
+    void processDirect(const std::complex<double>* input, std::size_t n, std::complex<double>* output)
+    {
+        std::size_t nHistory = history_.size();
+        std::size_t nTaps    = taps_.size();
+        extended_.resize( nHistory + n );
+        std::copy( history_.begin(), history_.end(), extended_.begin() );
+        std::copy( input, input + n, extended_.begin() + nHistory );
+        const double* samples = reinterpret_cast<const double*>( extended_.data() );
+        const double* taps    = reversedTaps_.data();
+        for (std::size_t t = 0; t < n; t++) {
+            const double* window = samples + 2 * t;
+            double re = 0, im = 0;
+            #pragma omp simd reduction(+:re, im)
+            for (std::size_t j = 0; j < nTaps; j++) {
+                re += taps[j] * window[ 2 * j ];
+                im += taps[j] * window[ 2 * j + 1 ];
+            }
+            output[t] = std::complex<double>( re, im );
+        }
+        std::copy( extended_.end() - nHistory, extended_.end(), history_.begin() );
+    }
+
+
+
+private:
+
+
+    // Multiplies spectra element by element, in place.
+    static void multiply(std::complex<double>* data, const std::complex<double>* factors, std::size_t n)
+    {
+        double*       a = reinterpret_cast<double*>( data );
+        const double* b = reinterpret_cast<const double*>( factors );
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double re = a[ 2 * i ] * b[ 2 * i ] - a[ 2 * i + 1 ] * b[ 2 * i + 1 ];
+            double im = a[ 2 * i ] * b[ 2 * i + 1 ] + a[ 2 * i + 1 ] * b[ 2 * i ];
+            a[ 2 * i ]     = re;
+            a[ 2 * i + 1 ] = im;
+        }
+    }
+
+
+
+    std::vector<double>                     taps_;
+    AlignedVector<double>                   reversedTaps_;
+    std::shared_ptr<const FFTPlan>          plan_;
+    AlignedVector<std::complex<double> >    spectrum_;
+    AlignedVector<std::complex<double> >    block_;
+    AlignedVector<std::complex<double> >    history_;
+    AlignedVector<std::complex<double> >    extended_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_OVERLAPSAVEFILTER_H
@@ -0,0 +1,268 @@
+// This class is a read-only source of payload bits which never expands
+// the whole payload in memory. Bits come either from a file mapped into
+// memory (any content, newlines included, bytes from MSB to LSB), from the
+// PRBS-23 pattern (x^23 + x^18 + 1, ITU-T O.150) repeated to a given
+// length, or from counter-based random bits. Every source reads any bit
+// position directly, so it can be shared by all workers of a sweep.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BitStream.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PAYLOADSOURCE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PAYLOADSOURCE_H
+
+
+class PayloadSource {
+public:
+
+
+    enum Kind {
+        FILE,       // Bytes of a memory-mapped file.
+        PRBS,       // PRBS-23 pattern.
+        RANDOM      // SplitMix64 of seed and word index.
+    };
+
+
+    /**
+     * Map a whole file into memory. Pages are read by the system on first
+     * access, so files larger than memory are fine.
+     *
+     * @param pathToFile is a path to the file.
+     * @return source of 8 * (file size) bits, empty if file cannot be read.
+     */
+    static PayloadSource fromFile(const std::string& pathToFile)
+    {
+        PayloadSource source( FILE, 0 );
+        int descriptor = open( pathToFile.c_str(), O_RDONLY );
+        if (descriptor < 0) {
+            std::cerr << "Error while opening file to read" << std::endl;
+            return source;
+        }
+        struct stat status;
+        if (fstat( descriptor, &status ) == 0 && status.st_size > 0) {
+            void* address = mmap( nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0 );
+            if (address != MAP_FAILED) {
+                madvise( address, status.st_size, MADV_SEQUENTIAL );
+                source.mapping_ = std::shared_ptr<const unsigned char>(
+                    static_cast<const unsigned char*>( address ),
+                    [length = std::size_t( status.st_size )](const unsigned char* p) { munmap( (void*)p, length ); } );
+                source.bytes_  = source.mapping_.get();
+                source.nBytes_ = status.st_size;
+                source.size_   = 8 * source.nBytes_;
+            }
+            else
+                std::cerr << "Error while mapping file to memory" << std::endl;
+        }
+        close( descriptor );
+        return source;
+    }
+
+
+    /**
+     * PRBS-23 pattern from the all-ones state, repeated to a given length.
+     * One period (1 MiB) is generated once and shared.
+     *
+     * @param nBits is a number of bits.
+     * @return source of nBits bits.
+     */
+    static PayloadSource prbs(std::uint64_t nBits)
+    {
+        PayloadSource source( PRBS, nBits );
+        source.pattern_ = &prbsPeriod();
+        return source;
+    }
+
+
+    /**
+     * Uniform random bits, a pure function of seed and position.
+     *
+     * @param nBits is a number of bits.
+     * @param seed is a key of the sequence.
+     * @return source of nBits bits.
+     */
+    static PayloadSource random(std::uint64_t nBits, std::uint64_t seed)
+    {
+        PayloadSource source( RANDOM, nBits );
+        source.seed_ = seed;
+        return source;
+    }
+
+
+    Kind getKind() const
+    {
+        return kind_;
+    }
+
+
+    // Returns number of bits.
+    std::uint64_t size() const
+    {
+        return size_;
+    }
+
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+
+    /**
+     * Read nBits bits starting from a given position as a number, like
+     * BitStream::read. Bits beyond the end read as zeros.
+     *
+     * @param position is an index of the first (most significant) bit.
+     * @param nBits is a number of bits, from 1 to 64.
+     * @return bits as a number.
+     */
+    std::uint64_t read(std::uint64_t position, int nBits) const
+    {
+        std::uint64_t bits;
+        switch (kind_) {
+            case FILE:
+                bits = readFile( position );
+                break;
+            case PRBS:
+                // Table holds a period and 64 more bits, so no read wraps.
+                bits = pattern_->read( position % PRBS_PERIOD, 64 );
+                break;
+            default:
+                bits = readRandom( position );
+        }
+        // Clear bits beyond the end.
+        if (position + 64 > size_)
+            bits &= position >= size_ ? 0 : ~std::uint64_t( 0 ) << (position + 64 - size_);
+        return bits >> (64 - nBits);
+    }
+
+
+    /**
+     * Copy all bits into a stream (for the staged chain which needs
+     * the whole payload anyway).
+     *
+     * @return packed binary data.
+     */
+    BitStream toBitStream() const
+    {
+        BitStream output;
+        output.reserve( size_ );
+        std::uint64_t position = 0;
+        for (; position + 64 <= size_; position += 64)
+            output.append( read( position, 64 ), 64 );
+        if (position < size_)
+            output.append( read( position, size_ - position ), size_ - position );
+        return output;
+    }
+
+
+
+private:
+
+
+    // Period of PRBS-23 in bits.
+    static constexpr std::uint64_t PRBS_PERIOD = (1u << 23) - 1;
+
+
+    PayloadSource(Kind kind, std::uint64_t nBits)
+        : kind_( kind ), size_( nBits )
+    {
+    }
+
+
+    // 64 bits of the file from a given position, bytes beyond the end are zeros.
+    std::uint64_t readFile(std::uint64_t position) const
+    {
+        std::uint64_t byte   = position / 8;
+        int           offset = position % 8;
+        std::uint64_t word   = 0;
+        unsigned      next   = 0;
+        if (byte + 9 <= nBytes_) {
+            std::memcpy( &word, bytes_ + byte, 8 );
+            if constexpr (std::endian::native == std::endian::little)
+                word = std::byteswap( word );
+            next = bytes_[ byte + 8 ];
+        }
+        else {
+            for (std::uint64_t i = byte; i < byte + 8; i++)
+                word = word << 8 | (i < nBytes_ ? bytes_[i] : 0);
+            next = byte + 8 < nBytes_ ? bytes_[ byte + 8 ] : 0;
+        }
+        return offset == 0 ? word : word << offset | next >> (8 - offset);
+    }
+
+
+    // 64 bits of the random sequence from a given position. Word w of the
+    // sequence is SplitMix64 of seed and w.
+    std::uint64_t readRandom(std::uint64_t position) const
+    {
+        std::uint64_t word   = position / 64;
+        int           offset = position % 64;
+        std::uint64_t bits   = randomWord( word );
+        return offset == 0 ? bits : bits << offset | randomWord( word + 1 ) >> (64 - offset);
+    }
+
+
+    std::uint64_t randomWord(std::uint64_t index) const
+    {
+        std::uint64_t x = seed_ + 0x9E3779B97F4A7C15ull * (index + 1);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+
+    // One period of PRBS-23 followed by its first 64 bits.
+    static const BitStream& prbsPeriod()
+    {
+        static const BitStream pattern = [] {
+            BitStream output;
+            output.reserve( PRBS_PERIOD + 64 );
+            std::uint32_t state = (1u << 23) - 1;
+            std::uint64_t word = 0;
+            int           nWordBits = 0;
+            for (std::uint64_t i = 0; i < PRBS_PERIOD + 64; i++) {
+                unsigned bit = (state >> 22 ^ state >> 17) & 1;
+                state = (state << 1 | bit) & ((1u << 23) - 1);
+                word = word << 1 | bit;
+                if (++nWordBits == 64) {
+                    output.append( word, 64 );
+                    word = 0;
+                    nWordBits = 0;
+                }
+            }
+            output.append( word, nWordBits );
+            return output;
+        }();
+        return pattern;
+    }
+
+
+
+    Kind                                    kind_;
+    std::uint64_t                           size_       = 0;
+    std::shared_ptr<const unsigned char>    mapping_;
+    const unsigned char*                    bytes_      = nullptr;
+    std::uint64_t                           nBytes_     = 0;
+    const BitStream*                        pattern_    = nullptr;
+    std::uint64_t                           seed_       = 0;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PAYLOADSOURCE_H
@@ -0,0 +1,531 @@
+// This class collects low-overhead counters of the hot path: calls,
+// symbols and time of every stage of the chain, random numbers drawn,
+// memory allocations and CPU time of sweep workers, and occupancy of the
+// queues between threads of AsyncPipeline. Every thread writes only its
+// own cache-line-aligned slot, a reader sums all slots without locks.
+// ProgressReporter prints a progress and ETA line while a sweep runs,
+// writeReport saves the totals as JSON.
+//
+// Everything is compiled out when GAUSSIAN_CHANNEL_PROFILE is 0: functions
+// become empty and scopes hold no state the optimizer has to keep.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef GAUSSIAN_CHANNEL_PROFILE
+#define GAUSSIAN_CHANNEL_PROFILE 0
+#endif
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PROFILER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PROFILER_H
+
+
+class Profiler {
+public:
+
+
+    static constexpr bool ENABLED = GAUSSIAN_CHANNEL_PROFILE != 0;
+
+
+    enum Stage {
+        MAP,            // Bits to constellation points.
+        NOISE,          // Noise generation and addition.
+        FADING,         // Fading gains and equalization.
+        FILTER,         // Pulse shaping and matched filters.
+        QUANTIZE,       // ADC quantization.
+        DEMAP,          // Hard decisions and bits.
+        SOFT_DEMAP,     // LLRs.
+        DECODE,         // Viterbi decoding.
+        COUNT,          // Comparison with transmitted bits.
+        N_STAGES
+    };
+
+
+    // Queues between stage threads of AsyncPipeline.
+    enum Queue {
+        SOURCE_TO_MAP,
+        MAP_TO_NOISE,
+        NOISE_TO_DEMAP,
+        DEMAP_TO_COUNT,
+        COUNT_TO_SOURCE,    // Free blocks.
+        N_QUEUES
+    };
+
+
+    // Times a stage from construction to destruction.
+    class Scope {
+    public:
+
+
+        /**
+         * Start timing a stage.
+         *
+         * @param stage is a stage of the chain.
+         * @param nSymbols is a number of symbols processed in the scope.
+         */
+        Scope(Stage stage, std::uint64_t nSymbols)
+        {
+            if constexpr (ENABLED) {
+                stage_    = stage;
+                nSymbols_ = nSymbols;
+                start_    = std::chrono::steady_clock::now();
+            }
+        }
+
+
+        ~Scope()
+        {
+            if constexpr (ENABLED) {
+                std::chrono::nanoseconds time = std::chrono::steady_clock::now() - start_;
+                Slot& s = slot();
+                add( s.calls[ stage_ ], 1 );
+                add( s.symbols[ stage_ ], nSymbols_ );
+                add( s.nanoseconds[ stage_ ], time.count() );
+            }
+        }
+
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+
+
+    private:
+
+
+        Stage                                   stage_      = MAP;
+        std::uint64_t                           nSymbols_   = 0;
+        std::chrono::steady_clock::time_point   start_;
+
+
+
+    };
+
+
+    // Measures CPU time and counts memory allocations of one sweep work
+    // item (trial) in the calling thread and marks the item as done at the
+    // end. Trials of a warmed-up worker are expected not to allocate.
+    class WorkScope {
+    public:
+
+
+        // @param nSymbols is a number of symbols of the item.
+        explicit WorkScope(std::uint64_t nSymbols)
+        {
+            if constexpr (ENABLED) {
+                nSymbols_    = nSymbols;
+                start_       = threadCpuTime();
+                allocations_ = slot().allocations.load( std::memory_order_relaxed );
+            }
+        }
+
+
+        ~WorkScope()
+        {
+            if constexpr (ENABLED) {
+                Slot& s = slot();
+                add( s.cpuNanoseconds, threadCpuTime() - start_ );
+                std::uint64_t allocations = s.allocations.load( std::memory_order_relaxed ) - allocations_;
+                add( s.trialAllocations, allocations );
+                add( s.allocatingTrials, allocations > 0 );
+                doneWork_.fetch_add( 1, std::memory_order_relaxed );
+                doneSymbols_.fetch_add( nSymbols_, std::memory_order_relaxed );
+            }
+        }
+
+
+        WorkScope(const WorkScope&) = delete;
+        WorkScope& operator=(const WorkScope&) = delete;
+
+
+
+    private:
+
+
+        std::uint64_t nSymbols_     = 0;
+        std::uint64_t start_        = 0;
+        std::uint64_t allocations_  = 0;
+
+
+
+    };
+
+
+    // Counts random numbers drawn by a noise generator.
+    static void addRandomDraws(std::uint64_t n)
+    {
+        if constexpr (ENABLED)
+            add( slot().randomDraws, n );
+    }
+
+
+    // Counts a memory allocation (called from operator new of the program).
+    static void addAllocation(std::size_t bytes)
+    {
+        if constexpr (ENABLED) {
+            Slot& s = slot();
+            add( s.allocations, 1 );
+            add( s.allocatedBytes, bytes );
+        }
+    }
+
+
+    // Adds planned work items (trials) of a sweep, shown by ProgressReporter.
+    static void addPlannedWork(std::uint64_t nItems)
+    {
+        if constexpr (ENABLED)
+            plannedWork_.fetch_add( nItems, std::memory_order_relaxed );
+    }
+
+
+    /**
+     * Add counters of a queue after a run of its threads.
+     *
+     * @param queue is a queue.
+     * @param capacity is a number of blocks the queue holds.
+     * @param pushes is a number of blocks pushed.
+     * @param samples is a number of pushes which sampled occupancy.
+     * @param occupancy is a sum of blocks in the queue before every sample.
+     * @param fullWaits is a number of pushes which waited for a free slot.
+     * @param emptyWaits is a number of pops which waited for a block.
+     */
+    static void addQueueStatistics(Queue queue, std::uint64_t capacity, std::uint64_t pushes, std::uint64_t samples,
+                                   std::uint64_t occupancy, std::uint64_t fullWaits, std::uint64_t emptyWaits)
+    {
+        if constexpr (ENABLED) {
+            QueueCounters& q = queues_[ queue ];
+            q.capacity.store( capacity, std::memory_order_relaxed );
+            add( q.pushes, pushes );
+            add( q.samples, samples );
+            add( q.occupancy, occupancy );
+            add( q.fullWaits, fullWaits );
+            add( q.emptyWaits, emptyWaits );
+        }
+    }
+
+
+    // Sums of counters of all threads.
+    struct Totals {
+        std::uint64_t calls[ N_STAGES ]         = {};
+        std::uint64_t symbols[ N_STAGES ]       = {};
+        std::uint64_t nanoseconds[ N_STAGES ]   = {};
+        std::uint64_t randomDraws               = 0;
+        std::uint64_t allocations               = 0;
+        std::uint64_t allocatedBytes            = 0;
+        std::uint64_t trialAllocations          = 0;
+        std::uint64_t allocatingTrials          = 0;
+        std::uint64_t cpuNanoseconds            = 0;
+        std::uint64_t plannedWork               = 0;
+        std::uint64_t doneWork                  = 0;
+        std::uint64_t doneSymbols               = 0;
+        // Most threads counting at the same time (slots are reused, so
+        // threads which come and go, like pipeline stages, count once).
+        unsigned      nThreads                  = 0;
+    };
+
+
+    // Reads all slots. Counters written concurrently may be slightly behind.
+    static Totals collect()
+    {
+        Totals totals;
+        if constexpr (ENABLED) {
+            auto sum = [&totals](const Slot& s) {
+                for (int i = 0; i < N_STAGES; i++) {
+                    totals.calls[i]       += s.calls[i].load( std::memory_order_relaxed );
+                    totals.symbols[i]     += s.symbols[i].load( std::memory_order_relaxed );
+                    totals.nanoseconds[i] += s.nanoseconds[i].load( std::memory_order_relaxed );
+                }
+                totals.randomDraws    += s.randomDraws.load( std::memory_order_relaxed );
+                totals.allocations    += s.allocations.load( std::memory_order_relaxed );
+                totals.allocatedBytes += s.allocatedBytes.load( std::memory_order_relaxed );
+                totals.trialAllocations += s.trialAllocations.load( std::memory_order_relaxed );
+                totals.allocatingTrials += s.allocatingTrials.load( std::memory_order_relaxed );
+                totals.cpuNanoseconds += s.cpuNanoseconds.load( std::memory_order_relaxed );
+            };
+            int nUsed = std::min( nSlots_.load(), MAX_SLOTS );
+            for (int i = 0; i < nUsed; i++)
+                sum( slots_[i] );
+            sum( retired_ );
+            totals.plannedWork = plannedWork_.load( std::memory_order_relaxed );
+            totals.doneWork    = doneWork_.load( std::memory_order_relaxed );
+            totals.doneSymbols = doneSymbols_.load( std::memory_order_relaxed );
+            totals.nThreads    = nUsed;
+        }
+        return totals;
+    }
+
+
+    // Returns name of a stage as used in the report.
+    static const char* stageName(int stage)
+    {
+        static const char* names[ N_STAGES ] = { "map", "noise", "fading", "filter", "quantize", "demap", "soft_demap", "decode", "count" };
+        return names[ stage ];
+    }
+
+
+    // Returns name of a queue as used in the report.
+    static const char* queueName(int queue)
+    {
+        static const char* names[ N_QUEUES ] = { "source_to_map", "map_to_noise", "noise_to_demap", "demap_to_count",
+                                                 "count_to_source" };
+        return names[ queue ];
+    }
+
+
+    /**
+     * Write totals as JSON.
+     *
+     * @param pathToFile is a path to the file in text (string) format.
+     * @param wallSeconds is a wall time of the run.
+     */
+    static void writeReport(const std::string& pathToFile, double wallSeconds)
+    {
+        if constexpr (!ENABLED) {
+            std::cerr << "Profiling is disabled at compile time (GAUSSIAN_CHANNEL_PROFILE=0)" << std::endl;
+            return;
+        }
+        std::ofstream out( pathToFile );
+        if (!out.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return;
+        }
+        Totals totals = collect();
+        out << "{" << std::endl;
+        out << "  \"wall_seconds\": " << wallSeconds << "," << std::endl;
+        out << "  \"process_cpu_seconds\": " << double( std::clock() ) / CLOCKS_PER_SEC << "," << std::endl;
+        out << "  \"worker_cpu_seconds\": " << totals.cpuNanoseconds * 1e-9 << "," << std::endl;
+        out << "  \"threads\": " << totals.nThreads << "," << std::endl;
+        out << "  \"trials\": " << totals.doneWork << "," << std::endl;
+        out << "  \"symbols\": " << totals.doneSymbols << "," << std::endl;
+        out << "  \"random_draws\": " << totals.randomDraws << "," << std::endl;
+        out << "  \"allocations\": " << totals.allocations << "," << std::endl;
+        out << "  \"allocated_bytes\": " << totals.allocatedBytes << "," << std::endl;
+        // Allocations inside trials and trials which allocated at all.
+        out << "  \"trial_allocations\": " << totals.trialAllocations << "," << std::endl;
+        out << "  \"allocating_trials\": " << totals.allocatingTrials << "," << std::endl;
+        out << "  \"stages\": {" << std::endl;
+        for (int i = 0; i < N_STAGES; i++) {
+            double seconds = totals.nanoseconds[i] * 1e-9;
+            out << "    \"" << stageName( i ) << "\": {\"calls\": " << totals.calls[i]
+                << ", \"symbols\": " << totals.symbols[i] << ", \"seconds\": " << seconds
+                << ", \"ns_per_symbol\": " << (totals.symbols[i] ? totals.nanoseconds[i] / double( totals.symbols[i] ) : 0)
+                << "}" << (i + 1 < N_STAGES ? "," : "") << std::endl;
+        }
+        out << "  }," << std::endl;
+        // Mean occupancy near capacity means the consumer of the queue is
+        // the bottleneck, near zero means the producer is.
+        out << "  \"queues\": {" << std::endl;
+        for (int i = 0; i < N_QUEUES; i++) {
+            const QueueCounters& q = queues_[i];
+            std::uint64_t samples = q.samples.load( std::memory_order_relaxed );
+            out << "    \"" << queueName( i ) << "\": {\"capacity\": " << q.capacity.load( std::memory_order_relaxed )
+                << ", \"pushes\": " << q.pushes.load( std::memory_order_relaxed )
+                << ", \"mean_occupancy\": " << (samples ? q.occupancy.load( std::memory_order_relaxed ) / double( samples ) : 0)
+                << ", \"full_waits\": " << q.fullWaits.load( std::memory_order_relaxed )
+                << ", \"empty_waits\": " << q.emptyWaits.load( std::memory_order_relaxed )
+                << "}" << (i + 1 < N_QUEUES ? "," : "") << std::endl;
+        }
+        out << "  }" << std::endl;
+        out << "}" << std::endl;
+    }
+
+
+
+private:
+
+
+    // Threads beyond this number share the last slot.
+    static constexpr int MAX_SLOTS = 256;
+
+
+    // Counters of one thread. Static slots are zero-initialized.
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> calls[ N_STAGES ];
+        std::atomic<std::uint64_t> symbols[ N_STAGES ];
+        std::atomic<std::uint64_t> nanoseconds[ N_STAGES ];
+        std::atomic<std::uint64_t> randomDraws;
+        std::atomic<std::uint64_t> allocations;
+        std::atomic<std::uint64_t> allocatedBytes;
+        std::atomic<std::uint64_t> trialAllocations;
+        std::atomic<std::uint64_t> allocatingTrials;
+        std::atomic<std::uint64_t> cpuNanoseconds;
+    };
+
+
+    struct QueueCounters {
+        std::atomic<std::uint64_t> capacity;
+        std::atomic<std::uint64_t> pushes;
+        std::atomic<std::uint64_t> samples;
+        std::atomic<std::uint64_t> occupancy;
+        std::atomic<std::uint64_t> fullWaits;
+        std::atomic<std::uint64_t> emptyWaits;
+    };
+
+
+    // Slot of the calling thread. Taken on first use, its counts move to
+    // retired_ when the thread exits, and it is given to the next thread.
+    static Slot& slot()
+    {
+        struct Owner {
+            int index;
+            Owner() : index( acquireSlot() ) {}
+            ~Owner() { releaseSlot( index ); }
+        };
+        thread_local Owner owner;
+        return slots_[ owner.index ];
+    }
+
+
+    static int acquireSlot()
+    {
+        for (int i = 0; i < MAX_SLOTS - 1; i++) {
+            bool free = false;
+            if (busy_[i].compare_exchange_strong( free, true )) {
+                // collect reads slots below nSlots_ only.
+                int n = nSlots_.load();
+                while (n < i + 1 && !nSlots_.compare_exchange_weak( n, i + 1 ))
+                    ;
+                return i;
+            }
+        }
+        nSlots_.store( MAX_SLOTS );
+        return MAX_SLOTS - 1;
+    }
+
+
+    static void releaseSlot(int index)
+    {
+        Slot& s = slots_[ index ];
+        for (int i = 0; i < N_STAGES; i++) {
+            add( retired_.calls[i],       s.calls[i].exchange( 0 ) );
+            add( retired_.symbols[i],     s.symbols[i].exchange( 0 ) );
+            add( retired_.nanoseconds[i], s.nanoseconds[i].exchange( 0 ) );
+        }
+        add( retired_.randomDraws,    s.randomDraws.exchange( 0 ) );
+        add( retired_.allocations,    s.allocations.exchange( 0 ) );
+        add( retired_.allocatedBytes, s.allocatedBytes.exchange( 0 ) );
+        add( retired_.trialAllocations, s.trialAllocations.exchange( 0 ) );
+        add( retired_.allocatingTrials, s.allocatingTrials.exchange( 0 ) );
+        add( retired_.cpuNanoseconds, s.cpuNanoseconds.exchange( 0 ) );
+        if (index < MAX_SLOTS - 1)
+            busy_[ index ].store( false );
+    }
+
+
+    // Atomic increment without ordering (a plain locked add on x86).
+    static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+    {
+        counter.fetch_add( value, std::memory_order_relaxed );
+    }
+
+
+    static std::uint64_t threadCpuTime()
+    {
+        timespec time;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &time );
+        return std::uint64_t( time.tv_sec ) * 1000000000 + time.tv_nsec;
+    }
+
+
+
+    static inline Slot                          slots_[ MAX_SLOTS ];
+    static inline std::atomic<bool>             busy_[ MAX_SLOTS ];
+    static inline std::atomic<int>              nSlots_             = 0;
+    static inline Slot                          retired_;
+    static inline std::atomic<std::uint64_t>    plannedWork_        = 0;
+    static inline std::atomic<std::uint64_t>    doneWork_           = 0;
+    static inline std::atomic<std::uint64_t>    doneSymbols_        = 0;
+    static inline QueueCounters                 queues_[ N_QUEUES ];
+
+
+
+};
+
+
+// This class prints a progress line (work items done, throughput, elapsed
+// time and ETA) to standard error every period while it exists. ETA of an
+// adaptive sweep covers trials planned so far.
+class ProgressReporter {
+public:
+
+
+    /**
+     * Start printing.
+     *
+     * @param periodSeconds is a time between lines, zero disables printing.
+     */
+    explicit ProgressReporter(double periodSeconds)
+    {
+        if constexpr (Profiler::ENABLED) {
+            if (periodSeconds <= 0)
+                return;
+            start_  = std::chrono::steady_clock::now();
+            thread_ = std::thread( [this, periodSeconds] {
+                std::unique_lock<std::mutex> lock( mutex_ );
+                while (!wakeUp_.wait_for( lock, std::chrono::duration<double>( periodSeconds ), [this] { return stop_; } ))
+                    print();
+            } );
+        }
+    }
+
+
+    ~ProgressReporter()
+    {
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            stop_ = true;
+        }
+        wakeUp_.notify_all();
+        thread_.join();
+        print();
+        std::cerr << std::endl;
+    }
+
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+
+
+private:
+
+
+    void print()
+    {
+        Profiler::Totals totals = Profiler::collect();
+        double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_ ).count();
+        double done    = totals.plannedWork ? 100.0 * totals.doneWork / totals.plannedWork : 0;
+        double eta     = totals.doneWork ? elapsed * (totals.plannedWork - totals.doneWork) / totals.doneWork : 0;
+        std::cerr << "\r" << std::fixed << std::setprecision( 1 )
+                  << "trials " << totals.doneWork << "/" << totals.plannedWork << " (" << done << "%)  "
+                  << (elapsed > 0 ? totals.doneSymbols / elapsed * 1e-6 : 0) << " Msym/s  "
+                  << "elapsed " << elapsed << " s  ETA " << eta << " s   " << std::defaultfloat << std::flush;
+    }
+
+
+
+    std::chrono::steady_clock::time_point   start_;
+    std::thread                             thread_;
+    std::mutex                              mutex_;
+    std::condition_variable                 wakeUp_;
+    bool                                    stop_ = false;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PROFILER_H
@@ -0,0 +1,189 @@
+// This class shapes symbols into an oversampled root-raised-cosine (RRC)
+// waveform at the transmitter and applies the matched RRC filter and
+// downsampling at the receiver. Taps have unit energy, so white noise of
+// a given deviation per sample has the same deviation per symbol after
+// the matched filter, and the chain gives the same BER as one sample per
+// symbol (apart from the small ISI of the truncated pulse). Both filters
+// are streaming OverlapSaveFilter objects.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "OverlapSaveFilter.h"
+#include "Profiler.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PULSESHAPER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PULSESHAPER_H
+
+
+// Pulse shaping of the chain.
+struct PulseShapingParameters {
+    bool    enabled         = false;
+    double  rolloff         = 0.25;     // Excess bandwidth, from 0 to 1.
+    int     span            = 16;       // Length of the pulse in symbols.
+    int     oversampling    = 8;        // Samples per symbol.
+    bool    direct          = false;    // Direct-form filters instead of FFT.
+};
+
+
+class PulseShaper {
+public:
+
+
+    explicit PulseShaper(const PulseShapingParameters& parameters = PulseShapingParameters())
+    {
+        setParameters( parameters );
+    }
+
+
+    void setParameters(const PulseShapingParameters& parameters)
+    {
+        parameters_ = parameters;
+        parameters_.span         = std::max( parameters_.span, 1 );
+        parameters_.oversampling = std::max( parameters_.oversampling, 1 );
+        filter_ = OverlapSaveFilter( rootRaisedCosine( parameters_.rolloff, parameters_.span, parameters_.oversampling ) );
+    }
+
+
+    const PulseShapingParameters& getParameters() const
+    {
+        return parameters_;
+    }
+
+
+    /**
+     * Calculate taps of the RRC pulse of unit energy.
+     *
+     * @param rolloff is an excess bandwidth, from 0 to 1.
+     * @param span is a length of the pulse in symbols.
+     * @param oversampling is a number of samples per symbol.
+     * @return span * oversampling + 1 taps, symmetric around the middle.
+     */
+    static std::vector<double> rootRaisedCosine(double rolloff, int span, int oversampling)
+    {
+        int                 nTaps = span * oversampling + 1;
+        std::vector<double> taps( nTaps );
+        double              energy = 0;
+        for (int i = 0; i < nTaps; i++) {
+            double t = (i - nTaps / 2) / double( oversampling );    // In symbols.
+            double value;
+            if (t == 0)
+                value = 1 - rolloff + 4 * rolloff / std::numbers::pi;
+            else if (rolloff > 0 && std::abs( std::abs( t ) - 1 / (4 * rolloff) ) < 1e-9)
+                value = rolloff / std::sqrt( 2.0 ) * ((1 + 2 / std::numbers::pi) * std::sin( std::numbers::pi / (4 * rolloff) )
+                                                    + (1 - 2 / std::numbers::pi) * std::cos( std::numbers::pi / (4 * rolloff) ));
+            else
+                value = (std::sin( std::numbers::pi * t * (1 - rolloff) ) + 4 * rolloff * t * std::cos( std::numbers::pi * t * (1 + rolloff) ))
+                      / (std::numbers::pi * t * (1 - (4 * rolloff * t) * (4 * rolloff * t)));
+            taps[i] = value;
+            energy += value * value;
+        }
+        for (double& i : taps)
+            i /= std::sqrt( energy );
+        return taps;
+    }
+
+
+    // Returns number of samples of the waveform of n symbols.
+    std::size_t getNumberOfSamples(std::size_t nSymbols) const
+    {
+        return nSymbols * parameters_.oversampling + filter_.getNumberOfTaps() - 1;
+    }
+
+
+    /**
+     * Shape symbols: insert oversampling - 1 zeros after every symbol and
+     * filter, the waveform includes the tail of the last pulse.
+     *
+     * @param symbols is a vector of modulated symbols.
+     * @return waveform of getNumberOfSamples(symbols.size()) samples.
+     */
+    std::vector<std::complex<double> > shape(const std::vector<std::complex<int> >& symbols)
+    {
+        std::vector<std::complex<double> > waveform( getNumberOfSamples( symbols.size() ) );
+        shape( symbols, waveform );
+        return waveform;
+    }
+
+
+    /**
+     * Shape symbols into a caller's buffer.
+     *
+     * @param symbols is a buffer of modulated symbols.
+     * @param waveform is a buffer of getNumberOfSamples(symbols.size())
+     * samples.
+     */
+    void shape(std::span<const std::complex<int> > symbols, std::span<std::complex<double> > waveform)
+    {
+        std::fill( waveform.begin(), waveform.end(), 0 );
+        for (std::size_t i = 0; i < symbols.size(); i++)
+            waveform[ i * parameters_.oversampling ] = std::complex<double>( symbols[i].real(), symbols[i].imag() );
+        filter_.reset();
+        filter( waveform.data(), waveform.size() );
+    }
+
+
+    /**
+     * Apply the matched filter and take one sample per symbol at the peak
+     * of its pulse.
+     *
+     * @param waveform is a received waveform of getNumberOfSamples(nSymbols)
+     * samples, filtered in place.
+     * @param nSymbols is a number of symbols.
+     * @return nSymbols received symbols.
+     */
+    std::vector<std::complex<double> > receive(std::vector<std::complex<double> >& waveform, std::size_t nSymbols)
+    {
+        std::vector<std::complex<double> > symbols( nSymbols );
+        receive( std::span<std::complex<double> >( waveform ), symbols );
+        return symbols;
+    }
+
+
+    /**
+     * Apply the matched filter into a caller's buffer of symbols.
+     *
+     * @param waveform is a received waveform of getNumberOfSamples(symbols.size())
+     * samples, filtered in place.
+     * @param symbols is a buffer of received symbols.
+     */
+    void receive(std::span<std::complex<double> > waveform, std::span<std::complex<double> > symbols)
+    {
+        filter_.reset();
+        filter( waveform.data(), waveform.size() );
+        // Pulse of symbol i peaks after both filters at i * oversampling + taps - 1.
+        std::size_t delay = filter_.getNumberOfTaps() - 1;
+        for (std::size_t i = 0; i < symbols.size(); i++)
+            symbols[i] = waveform[ i * parameters_.oversampling + delay ];
+    }
+
+
+
+private:
+
+
+    void filter(std::complex<double>* samples, std::size_t n)
+    {
+        Profiler::Scope profile( Profiler::FILTER, n );
+        if (parameters_.direct)
+            filter_.processDirect( samples, n, samples );
+        else
+            filter_.process( samples, n, samples );
+    }
+
+
+
+    PulseShapingParameters  parameters_;
+    OverlapSaveFilter       filter_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_PULSESHAPER_H
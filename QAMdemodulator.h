@@ -1,10 +1,20 @@
 // This class do simple QAM demodulation based on Euclidian distance.
+// Decisions are made by a per-axis slicer, which is the same as the
+// nearest point search for square constellations.
 //
 // Created by Konstantin Terentev on 05.09.2024 for YADRO.
 
+#include <algorithm>
+#include <cmath>
 #include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
 #include <vector>
 
+#include "Profiler.h"
+
 #ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_QAMDEMODULATOR_H
 #define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_QAMDEMODULATOR_H
 
@@ -16,90 +26,376 @@ public:
     /*
      * TODO: normalization of input signal (in general its necessary, but in our task there is no need)
      */
-    std::vector<std::complex<int> > normalize(const std::vector<std::complex<int> > input)
+    std::vector<std::complex<int> > normalize([[maybe_unused]] const std::vector<std::complex<int> > input)
     {
         std::vector<std::complex<int> > signalNormalized;
         return signalNormalized;
     }
 
 
+    /**
+     * Hard-decision slicer. Rounds real and imaginary parts separately to
+     * the nearest value of the odd-integer axis grid, clamping samples
+     * beyond the outer points onto them, so the cost does not depend on
+     * modulation order. The loop has no branches and is vectorized.
+     *
+     * @param inputData is a buffer of n received symbols.
+     * @param n is a number of symbols.
+     * @param nReImValues is a number of values in each axis (sqrt of order).
+     * @param symbolIndices is a buffer of n indices of the nearest points in
+     * vector made by createComplexValuesConstellation.
+     */
+    static void sliceData(const std::complex<double>*   inputData,
+                          std::size_t                   n,
+                          int                           nReImValues,
+                          int*                          symbolIndices)
+    {
+        // Array of complex is an array of (real, imag) pairs.
+        const double* samples = reinterpret_cast<const double*>( inputData );
+        // Axis values go from nReImValues-1 down by 2, so the position of x is
+        // (nReImValues-1-x)/2. Adding 1/2 and truncating rounds it.
+        const double maxPosition = nReImValues - 0.5;
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double column = (nReImValues - samples[ 2 * i ]) * 0.5;
+            double row    = (nReImValues - samples[ 2 * i + 1 ]) * 0.5;
+            column = std::min( std::max( column, 0.0 ), maxPosition );
+            row    = std::min( std::max( row,    0.0 ), maxPosition );
+            symbolIndices[i] = int( row ) * nReImValues + int( column );
+        }
+    }
+
+
+    /**
+     * Hard-decision slicer of symbols given as separate arrays of real
+     * and imaginary parts, otherwise the same as above.
+     *
+     * @param re is a buffer of n real parts of received symbols.
+     * @param im is a buffer of n imaginary parts of received symbols.
+     * @param n is a number of symbols.
+     * @param nReImValues is a number of values in each axis (sqrt of order).
+     * @param symbolIndices is a buffer of n indices of the nearest points.
+     */
+    static void sliceData(const double* re, const double* im, std::size_t n, int nReImValues, int* symbolIndices)
+    {
+        const double maxPosition = nReImValues - 0.5;
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            double column = (nReImValues - re[i]) * 0.5;
+            double row    = (nReImValues - im[i]) * 0.5;
+            column = std::min( std::max( column, 0.0 ), maxPosition );
+            row    = std::min( std::max( row,    0.0 ), maxPosition );
+            symbolIndices[i] = int( row ) * nReImValues + int( column );
+        }
+    }
+
+
+    /**
+     * Hard-decision slicer of symbols in single precision, otherwise the
+     * same as above. Twice as many symbols fit a SIMD register.
+     *
+     * @param re is a buffer of n real parts of received symbols.
+     * @param im is a buffer of n imaginary parts of received symbols.
+     * @param n is a number of symbols.
+     * @param nReImValues is a number of values in each axis (sqrt of order).
+     * @param symbolIndices is a buffer of n indices of the nearest points.
+     */
+    static void sliceData(const float* re, const float* im, std::size_t n, int nReImValues, int* symbolIndices)
+    {
+        const float maxPosition = nReImValues - 0.5f;
+        const float axisLength  = float( nReImValues );
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            float column = (axisLength - re[i]) * 0.5f;
+            float row    = (axisLength - im[i]) * 0.5f;
+            column = std::min( std::max( column, 0.0f ), maxPosition );
+            row    = std::min( std::max( row,    0.0f ), maxPosition );
+            symbolIndices[i] = int( row ) * nReImValues + int( column );
+        }
+    }
+
+
+    /**
+     * Hard-decision slicer of quantized symbols (see AdcQuantizer). A
+     * position of an axis is the number of thresholds a code is not above,
+     * so there are only comparisons of packed int16 values: one pass over
+     * the symbols per threshold, both axes at once.
+     *
+     * @param re is a buffer of n real codes of received symbols.
+     * @param im is a buffer of n imaginary codes of received symbols.
+     * @param n is a number of symbols.
+     * @param nReImValues is a number of values in each axis (sqrt of order).
+     * @param thresholds is up to nReImValues - 1 decision thresholds in
+     * codes, descending (missing lower ones are never passed).
+     * @param symbolIndices is a buffer of n indices of the nearest points.
+     */
+    static void sliceData(const std::int16_t* re, const std::int16_t* im, std::size_t n, int nReImValues,
+                          std::span<const std::int16_t> thresholds, std::int16_t* symbolIndices)
+    {
+        const std::int16_t axisLength = std::int16_t( nReImValues );
+        std::fill( symbolIndices, symbolIndices + n, std::int16_t( 0 ) );
+        for (std::int16_t threshold : thresholds) {
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; i++)
+                symbolIndices[i] += std::int16_t( (im[i] <= threshold ? axisLength : 0) + (re[i] <= threshold ? 1 : 0) );
+        }
+    }
+
+
     /**
      * Demap input QAM modulated data.
      *
      * @param inputData is a complex vector of modulated data.
-     * @param complexValuesConstellation is a vector of complex symbols.
-     * @param GreyCodes is a vector of Grey codes in decimal format.
-     * @return vector of binary demapped data.
+     * @param constellationTable is a lookup tables of the constellation.
+     * @return packed binary demapped data.
      */
-    std::vector<int> demapData(const std::vector<std::complex<double> >&    inputData,
-                               const std::vector<std::complex<int> >&       complexValuesConstellation,
-                               const std::vector<int>&                      GreyCodes)
-                               {
-        std::vector<int> outputData;
-        // The simplest way is to use the Euclidean distance
-        double distance = sqrt( pow(( complexValuesConstellation[1].real() - complexValuesConstellation[2].real() ),2 ) );
-        int symbolIndex = -1;
-        for (std::complex<double> i : inputData) {
-            for (int j = 0; j < complexValuesConstellation.size(); j++)
-                if (   i.real() >= complexValuesConstellation[j].real() - distance / 2
-                    && i.real() <= complexValuesConstellation[j].real() + distance / 2
-                    && i.imag() >= complexValuesConstellation[j].imag() - distance / 2
-                    && i.imag() <= complexValuesConstellation[j].imag() + distance / 2) {
-                    symbolIndex = j;
-                    break;
-                }
-            outputData.push_back( GreyCodes[ symbolIndex ] );
-        }
-        std::vector<int> outputDataBinary = decimalToBinary( outputData, log2( getModulationOrder() ) );
+    BitStream demapData(const std::vector<std::complex<double> >&   inputData,
+                        const ConstellationTable&                   constellationTable)
+                        {
+        std::vector<int> symbolIndices( inputData.size() );
+        BitStream        outputDataBinary;
+        demapData( inputData, constellationTable, symbolIndices, outputDataBinary );
         return outputDataBinary;
     }
 
 
+    /**
+     * Demap input QAM modulated data into caller's buffers. Memory of
+     * outputData is reused, so nothing is allocated once it is large enough.
+     *
+     * @param inputData is a buffer of modulated data.
+     * @param constellationTable is a lookup tables of the constellation.
+     * @param symbolIndices is a scratch buffer of inputData.size() values.
+     * @param outputData is a packed binary demapped data, overwritten.
+     */
+    static void demapData(std::span<const std::complex<double> >    inputData,
+                          const ConstellationTable&                 constellationTable,
+                          std::span<int>                            symbolIndices,
+                          BitStream&                                outputData)
+    {
+        Profiler::Scope profile( Profiler::DEMAP, inputData.size() );
+        sliceData( inputData.data(), inputData.size(), constellationTable.getNumberOfAxisValues(), symbolIndices.data() );
+        std::span<const int> GreyCodes = constellationTable.getGreyCodes();
+        for (std::size_t i = 0; i < inputData.size(); i++)
+            symbolIndices[i] = GreyCodes[ symbolIndices[i] ];
+        decimalToBinary( symbolIndices.first( inputData.size() ), constellationTable.getBitsPerSymbol(), outputData );
+    }
+
+
     /**
      * QAM-Demodulate input data.
      *
      * @param inputData is a complex vector of modulated data.
-     * @return vector of binary demapped data.
+     * @return packed binary demapped data.
      */
-    std::vector<int> demodulateData(const std::vector<std::complex<double> >& inputData,
+    BitStream demodulateData(const std::vector<std::complex<double> >& inputData,
                                     int modulationOrder)
     {
-        std::vector<std::complex<int> >     complexValuesConstellation  = createComplexValuesConstellation( log2( modulationOrder ) );
-        std::vector<int>                    GreyCodes                   = createGreyCodes( getModulationOrder() );
-        std::vector<int>                    dataDemodulated             = demapData( inputData, complexValuesConstellation, GreyCodes );
+        const ConstellationTable& constellationTable = ConstellationTable::isSupported( modulationOrder )
+                                                     ? ConstellationTable::forOrder( modulationOrder )
+                                                     : getConstellationTable();
+        BitStream dataDemodulated = demapData( inputData, constellationTable );
         return dataDemodulated;
     }
 
 
+    /**
+     * QAM-Demodulate input data into caller's buffers.
+     *
+     * @param inputData is a buffer of modulated data.
+     * @param modulationOrder is a modulation order.
+     * @param symbolIndices is a scratch buffer of inputData.size() values.
+     * @param outputData is a packed binary demapped data, overwritten.
+     */
+    void demodulateData(std::span<const std::complex<double> >  inputData,
+                        int                                     modulationOrder,
+                        std::span<int>                          symbolIndices,
+                        BitStream&                              outputData)
+    {
+        const ConstellationTable& constellationTable = ConstellationTable::isSupported( modulationOrder )
+                                                     ? ConstellationTable::forOrder( modulationOrder )
+                                                     : getConstellationTable();
+        demapData( inputData, constellationTable, symbolIndices, outputData );
+    }
+
+
+    /**
+     * Soft QAM-Demodulate input data with current modulation order.
+     * Writes max-log log-likelihood ratio ln(P(b=0)/P(b=1)) of every bit,
+     * bits go in the same order as in demodulateData. Every axis is
+     * handled separately with exact max-log formulas, so cost per bit
+     * does not depend on modulation order.
+     *
+     * @param inputData is a complex vector of modulated noised data.
+     * @param noiseDeviation is a standard deviation of noise in each of
+     * real and imaginary parts (see GaussianChannel::getNoiseDeviation).
+     * @param LLRs is a buffer of inputData.size() * log2(order) values.
+     */
+    void demodulateData(std::span<const std::complex<double> >  inputData,
+                        double                                  noiseDeviation,
+                        std::span<float>                        LLRs)
+    {
+        softDemapData( inputData, noiseDeviation, 1, LLRs.data() );
+    }
+
+
+    /**
+     * Soft QAM-Demodulate input data into 8-bit LLRs: round(LLR * scale)
+     * saturated to [-127, 127].
+     *
+     * @param inputData is a complex vector of modulated noised data.
+     * @param noiseDeviation is a standard deviation of noise in each of
+     * real and imaginary parts.
+     * @param scale is a number of quantization steps per unit of LLR.
+     * @param LLRs is a buffer of inputData.size() * log2(order) values.
+     */
+    void demodulateData(std::span<const std::complex<double> >  inputData,
+                        double                                  noiseDeviation,
+                        double                                  scale,
+                        std::span<std::int8_t>                  LLRs)
+    {
+        softDemapData( inputData, noiseDeviation, scale, LLRs.data() );
+    }
+
+
 
 private:
 
 
+    // Number of symbols soft-demapped at once.
+    static constexpr std::size_t SOFT_BATCH = 256;
+
+
+    /**
+     * Common part of soft demodulation. Point of the constellation is
+     * (column, row), bits of its code are Grey code of row (high half),
+     * Grey code of column (low half) with the MSB of the low half XORed
+     * with the LSB of row. Max-log LLR of XOR of bits of different axes is
+     * sign(a) sign(b) min(|a|, |b|) of their LLRs.
+     */
+    template <typename T>
+    void softDemapData(std::span<const std::complex<double> > inputData, double noiseDeviation, double scale, T* LLRs)
+    {
+        const ConstellationTable& table = getConstellationTable();
+        const int       bitsPerSymbol   = table.getBitsPerSymbol();
+        const int       m               = bitsPerSymbol / 2;
+        const int       nReImValues     = table.getNumberOfAxisValues();
+        const double    factor          = 2 / (noiseDeviation * noiseDeviation);
+        const double*   samples         = reinterpret_cast<const double*>( inputData.data() );
+        Profiler::Scope profile( Profiler::SOFT_DEMAP, inputData.size() );
+
+        alignas(64) double  positions[2][SOFT_BATCH];
+        alignas(64) int     indices[2][SOFT_BATCH];
+        alignas(64) float   planes[ 2 * 6 + 2 ][SOFT_BATCH];
+        for (std::size_t begin = 0; begin < inputData.size(); begin += SOFT_BATCH) {
+            std::size_t count = std::min( SOFT_BATCH, inputData.size() - begin );
+            // Positions of samples along axes in units of point index, and
+            // indices of the nearest points (same as sliceData).
+            #pragma omp simd
+            for (std::size_t i = 0; i < count; i++) {
+                for (int axis = 0; axis < 2; axis++) {
+                    double position = (nReImValues - 1 - samples[ 2 * (begin + i) + axis ]) * 0.5;
+                    positions[axis][i] = position;
+                    indices[axis][i]   = int( std::min( std::max( position + 0.5, 0.0 ), nReImValues - 0.5 ) );
+                }
+            }
+            // Grey bit t of an axis: runs of 2^(t+1) points, shifted by 2^t.
+            for (int t = 0; t < m; t++) {
+                axisLLRs( positions[1], indices[1], count, t + 1, 1 << t, nReImValues, factor, planes[ m - 1 - t ] );
+                if (t < m - 1)
+                    axisLLRs( positions[0], indices[0], count, t + 1, 1 << t, nReImValues, factor, planes[ bitsPerSymbol - 1 - t ] );
+            }
+            // MSB of column XOR LSB of row (runs of single points).
+            float* column = planes[ bitsPerSymbol ];
+            float* row    = planes[ bitsPerSymbol + 1 ];
+            axisLLRs( positions[0], indices[0], count, m, 1 << (m - 1), nReImValues, factor, column );
+            axisLLRs( positions[1], indices[1], count, 0, 0, nReImValues, factor, row );
+            #pragma omp simd
+            for (std::size_t i = 0; i < count; i++)
+                planes[m][i] = std::copysign( std::min( std::abs( column[i] ), std::abs( row[i] ) ), column[i] * row[i] );
+            // Interleave bit planes into symbol order.
+            T* output = LLRs + begin * bitsPerSymbol;
+            for (std::size_t i = 0; i < count; i++) {
+                for (int j = 0; j < bitsPerSymbol; j++) {
+                    if constexpr (std::is_same_v<T, float>)
+                        output[ i * bitsPerSymbol + j ] = planes[j][i];
+                    else
+                        output[ i * bitsPerSymbol + j ] = T( std::nearbyint( std::clamp( planes[j][i] * scale, -127.0, 127.0 ) ) );
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Max-log LLRs of one bit along one axis. Label of point c is bit 0 of
+     * (c + offset) >> shift, so points with equal label form runs. The
+     * nearest point with the other label is next to the run of the hard
+     * decision, on the side closer to the sample.
+     *
+     * @param positions is a buffer of sample positions in units of point index.
+     * @param indices is a buffer of indices of the nearest points.
+     * @param n is a number of samples.
+     * @param shift is a binary logarithm of run length.
+     * @param offset is a shift of runs.
+     * @param nReImValues is a number of points in the axis.
+     * @param factor is 2 / sigma^2.
+     * @param LLRs is a buffer of n LLRs to write.
+     */
+    static void axisLLRs(const double* positions, const int* indices, std::size_t n,
+                         int shift, int offset, int nReImValues, double factor, float* LLRs)
+    {
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; i++) {
+            int     key     = (indices[i] + offset) >> shift;
+            int     start   = (key << shift) - offset;
+            int     before  = start - 1;
+            int     after   = start + (1 << shift);
+            double  u       = positions[i];
+            // Bitwise operators instead of && and || keep the loop free of branches.
+            int     useBefore = (before >= 0) & ((after >= nReImValues) | (u - before < after - u));
+            double  other   = after - useBefore * (after - before);
+            double  hard    = indices[i];
+            // ((u - other)^2 - (u - hard)^2) in axis units is 4 times smaller
+            // than in signal units, so factor/4 * 4 = factor.
+            double  magnitude = factor * (hard - other) * (2 * u - other - hard);
+            LLRs[i] = float( magnitude * (1 - 2 * (key & 1)) );
+        }
+    }
+
+
     /**
-     * Convert decimal data vector to binary data vector.
+     * Convert decimal data vector to binary data.
      *
      * @param input is a decimal vector.
      * @param nDigits is a number bits to convert to binary.
-     * @return vector of binary data.
+     * @return packed binary data.
      */
-    std::vector<int> decimalToBinary(const std::vector<int>& input,
-                                     int nDigits)
+    BitStream decimalToBinary(const std::vector<int>& input,
+                              int nDigits)
     {
-        std::vector<int> output;
-        int remain;
-        int powerOf2;
-        for (int i = 0; i < input.size(); i++) {
-            remain = input[i];
-            for (int j = nDigits - 1; j >= 0; j--) {
-                powerOf2 = pow( 2,j );
-                output.push_back( remain / powerOf2 );
-                remain = remain % powerOf2;
-            }
-        }
+        BitStream output;
+        decimalToBinary( input, nDigits, output );
         return output;
     }
 
 
+    /**
+     * Convert decimal data to binary data, memory of output is reused.
+     *
+     * @param input is a decimal buffer.
+     * @param nDigits is a number bits to convert to binary.
+     * @param output is a packed binary data, overwritten.
+     */
+    static void decimalToBinary(std::span<const int> input, int nDigits, BitStream& output)
+    {
+        output.clear();
+        output.reserve( input.size() * nDigits );
+        for (int i : input)
+            output.append( i, nDigits );
+    }
+
+
 
 };
 
@@ -4,10 +4,17 @@
 //
 // Created by Konstantin Terentev on 05.09.2024 for YADRO.
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <complex>
+#include <span>
 #include <vector>
 
+#include "BitStream.h"
+#include "ConstellationTable.h"
+#include "Profiler.h"
+
 #ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_QAMMODULATOR_H
 #define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_QAMMODULATOR_H
 
@@ -50,6 +57,14 @@ public:
         else {
             modulationOrder_ = modulationOrderInput;
         }
+        if (!ConstellationTable::isSupported( modulationOrder_ )) {
+            std::cerr << "Modulation order " << modulationOrder_ << " is unsupported. Supported orders are powers of 4 from "
+                      << ConstellationTable::MIN_ORDER << " to " << ConstellationTable::MAX_ORDER
+                      << ". The value of the modulation order is set to 16. \nПорядок модуляции " << modulationOrder_
+                      << " не поддерживается. Установлено значение порядка модуляции равное 16.\n" << std::endl;
+            modulationOrder_ = 16;
+        }
+        constellationTable_ = &ConstellationTable::forOrder( modulationOrder_ );
     }
 
 
@@ -60,6 +75,13 @@ public:
     }
 
 
+    // Returns lookup tables of the current modulation order.
+    const ConstellationTable& getConstellationTable()
+    {
+        return *constellationTable_;
+    }
+
+
     /**
      * Calculates complex values in a signal constellation of a given size.
      *
@@ -68,19 +90,10 @@ public:
      */
     std::vector<std::complex<int> > createComplexValuesConstellation(int bitsPerSymbol)
     {
-        // Number of values in each axis.
-        int nReImValues = pow(2, bitsPerSymbol / 2);
-        // Fill axis values. Because of rectangular constellation
-        // real and imaginary parts are equal.
-        std::vector<int> ReImValues;
-        for (int i = nReImValues - 1; i >= -nReImValues; i -= 2)
-            ReImValues.push_back(i);
-        // Makes vector of complex numbers.
-        std::vector<std::complex<int> > complexValuesConstellation;
-        for (int j: ReImValues)
-            for (int i: ReImValues)
-                complexValuesConstellation.push_back(std::complex<int>(i, j));
-        return complexValuesConstellation;
+        // Values of every axis go from sqrt(M)-1 down to -(sqrt(M)-1) by 2,
+        // imaginary part changes slower. Tables are made at compile time.
+        std::span<const std::complex<int> > points = ConstellationTable::forOrder( 1 << bitsPerSymbol ).getPoints();
+        return std::vector<std::complex<int> >( points.begin(), points.end() );
     }
 
 
@@ -103,93 +116,120 @@ public:
     /**
      * Map input data to QAM constellation aka do mapping.
      *
-     * @param inputData is a vector of binary data.
-     * @param complexValuesConstellation is a vector of complex symbols.
-     * @param GreyCodes is a vector of Grey codes in decimal format.
+     * @param inputData is a packed binary data.
+     * @param constellationTable is a lookup tables of the constellation.
      * @return complex vector of mapped data.
      */
-    std::vector<std::complex<int> > mapData(const std::vector<int>& inputData, int bitsPerSymbol,
-                                            const std::vector<std::complex<int> >& complexValuesConstellation,
-                                            const std::vector<int>& GreyCodes)
+    std::vector<std::complex<int> > mapData(const BitStream& inputData,
+                                            const ConstellationTable& constellationTable)
                                             {
-        std::vector<std::complex<int> > outputData;
-        std::vector<int> inputDataDecimal = binaryToDecimal( inputData, bitsPerSymbol );
-        for (int i : inputDataDecimal)
-            outputData.push_back( complexValuesConstellation[ findIndex( GreyCodes, i ) ] );
+        int bitsPerSymbol = constellationTable.getBitsPerSymbol();
+        std::vector<std::complex<int> > outputData( (inputData.size() + bitsPerSymbol - 1) / bitsPerSymbol );
+        mapData( inputData, constellationTable, outputData );
         return outputData;
     }
 
 
     /**
-     * QAM-Modulate input data aka do impulse modulation.
+     * Map input data to QAM constellation into a caller's buffer.
      *
-     * @param inputData is a vector of binary data.
-     * @return complex vector of modulated data.
+     * @param inputData is a packed binary data.
+     * @param constellationTable is a lookup tables of the constellation.
+     * @param outputData is a buffer of ceil(inputData.size() / log2(order))
+     * mapped symbols.
      */
-    std::vector<std::complex<int> > modulateData(const std::vector<int> inputData)
+    static void mapData(const BitStream&                    inputData,
+                        const ConstellationTable&           constellationTable,
+                        std::span<std::complex<int> >       outputData)
     {
-        // Call method to create constellation of a given size.
-        std::vector<std::complex<int> > complexValuesConstellation = createComplexValuesConstellation(log2(getModulationOrder()));
-        // Call method to create Grey codes of a given number.
-        std::vector<int> GreyCodes = createGreyCodes(getModulationOrder());
-        // Map data.
-        std::vector<std::complex<int> > dataModulated = mapData(inputData, log2(getModulationOrder()), complexValuesConstellation, GreyCodes);
-        return dataModulated;
+        int bitsPerSymbol = constellationTable.getBitsPerSymbol();
+        std::span<const std::complex<int> > pointsOfCodes = constellationTable.getPointsOfCodes();
+        Profiler::Scope profile( Profiler::MAP, outputData.size() );
+        for (std::size_t i = 0; i < outputData.size(); i++)
+            outputData[i] = pointsOfCodes[ inputData.read( i * bitsPerSymbol, bitsPerSymbol ) ];
     }
 
 
+    /**
+     * Map symbols of data to separate arrays of real and imaginary parts
+     * in single precision.
+     *
+     * @param inputData is a packed binary data. Any type with read(position,
+     * nBits) like BitStream, bits beyond the end must read as zeros.
+     * @param firstSymbol is an index of the first symbol to map.
+     * @param n is a number of symbols.
+     * @param constellationTable is a lookup tables of the constellation.
+     * @param codes is a buffer of n codes of symbols to write.
+     * @param re is a buffer of n real parts to write.
+     * @param im is a buffer of n imaginary parts to write.
+     */
+    template <typename Source>
+    static void mapData(const Source& inputData, std::size_t firstSymbol, std::size_t n,
+                        const ConstellationTable& constellationTable, unsigned* codes, float* re, float* im)
+    {
+        int bitsPerSymbol = constellationTable.getBitsPerSymbol();
+        std::span<const std::complex<int> > pointsOfCodes = constellationTable.getPointsOfCodes();
+        Profiler::Scope profile( Profiler::MAP, n );
+        for (std::size_t i = 0; i < n; i++) {
+            codes[i] = inputData.read( (firstSymbol + i) * bitsPerSymbol, bitsPerSymbol );
+            re[i]    = float( pointsOfCodes[ codes[i] ].real() );
+            im[i]    = float( pointsOfCodes[ codes[i] ].imag() );
+        }
+    }
 
-private:
+
+    /**
+     * QAM-Modulate input data aka do impulse modulation.
+     *
+     * @param inputData is a packed binary data.
+     * @return complex vector of modulated data.
+     */
+    std::vector<std::complex<int> > modulateData(const BitStream& inputData)
+    {
+        // Constellation and Grey codes are built once per order (see setModulationOrder).
+        std::vector<std::complex<int> > dataModulated = mapData(inputData, getConstellationTable());
+        return dataModulated;
+    }
 
 
     /**
-     * Finds index of an element in vector.
+     * QAM-Modulate input data into a caller's buffer, nothing is allocated.
      *
-     * @param vectorToExplore is a vector to explore, obviously.
-     * @param elementToFind is an element to find, obviously...
-     * @return index of an element in vector.
+     * @param inputData is a packed binary data.
+     * @param outputData is a buffer of ceil(inputData.size() / log2(order))
+     * modulated symbols.
      */
-    int findIndex(std::vector<int> vectorToExplore,
-                  int elementToFind)
+    void modulateData(const BitStream& inputData, std::span<std::complex<int> > outputData)
     {
-        auto position = find( vectorToExplore.begin(), vectorToExplore.end(), elementToFind );
-        int index;
-        if ( position != vectorToExplore.end() )
-            index = position - vectorToExplore.begin();
-        else
-            std::cerr << "The value was not found \nЗначение не найдено \n";
-        return index;
+        mapData( inputData, getConstellationTable(), outputData );
     }
 
 
+
+private:
+
+
     /**
-     * Convert binary data vector to decimal data vector.
+     * Convert binary data to decimal data vector.
      *
-     * @param input is a binary vector.
+     * @param input is a packed binary data.
      * @param nDigits is a number bits to convert to decimal.
-     * @return vector of decimal data.
+     * @return vector of decimal data. Incomplete last group of bits
+     * is padded with zeros.
      */
-    std::vector<int> binaryToDecimal(const std::vector<int>& input,
-                                     int& nDigits)
+    std::vector<int> binaryToDecimal(const BitStream& input,
+                                     int nDigits)
     {
-        std::vector<int> output;
-        int power         =  nDigits-1;
-        int decimalValue  =  0;
-        for (int j = 0; j < input.size(); j++) {
-            decimalValue += input[j] * pow( 2, power );
-            power -= 1;
-            if ((j+1) % nDigits == 0) {
-                output.push_back( decimalValue );
-                decimalValue = 0;
-                power = nDigits - 1;
-            }
-        }
+        std::vector<int> output( (input.size() + nDigits - 1) / nDigits );
+        for (std::size_t j = 0; j < output.size(); j++)
+            output[j] = input.read( j * nDigits, nDigits );
         return output;
     }
 
 
 
-    int modulationOrder_;
+    int                         modulationOrder_ = 16;
+    const ConstellationTable*   constellationTable_ = &ConstellationTable::forOrder( 16 );
 
 
 
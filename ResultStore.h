@@ -0,0 +1,184 @@
+// This class keeps results of finished sweep points in a binary file of
+// fixed-size records. A record is appended and flushed as soon as its
+// point is finished, so an interrupted sweep loses only the points which
+// were running. Records carry a hash of the sweep configuration and a
+// checksum; on opening, a torn last record is dropped and the sweep skips
+// points which already have a record of the same configuration. A store
+// opened read-only (the merge tool) is never created, cut or written.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_RESULTSTORE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_RESULTSTORE_H
+
+
+class ResultStore {
+public:
+
+
+    // One finished (order, SNR) point.
+    struct Record {
+        std::uint64_t   configurationHash   = 0;
+        std::int32_t    modulationOrder     = 0;
+        std::int32_t    flags               = 0;    // IMPORTANCE_SAMPLING.
+        double          SNR                 = 0;
+        std::uint64_t   seed                = 0;
+        std::uint64_t   errors              = 0;
+        std::uint64_t   bits                = 0;
+        std::uint64_t   trials              = 0;
+        double          weightedErrors          = 0;
+        double          weightedErrorsSquared   = 0;
+        std::uint64_t   checksum            = 0;    // Of all fields above.
+    };
+    static_assert( std::is_trivially_copyable_v<Record> && sizeof(Record) == 80 );
+
+
+    // Record flag: BER is weightedErrors / bits.
+    static constexpr std::int32_t IMPORTANCE_SAMPLING = 1;
+
+
+    /**
+     * Open a store, creating the file if it does not exist, and read
+     * its valid records.
+     *
+     * @param pathToFile is a path to the file of the store.
+     * @param readOnly is true to only read records: a missing file is an
+     * error, a torn tail is skipped but stays in the file, and appended
+     * records are kept in memory only.
+     */
+    explicit ResultStore(const std::string& pathToFile, bool readOnly = false)
+        : pathToFile_( pathToFile )
+    {
+        std::ifstream in( pathToFile, std::ios::binary );
+        bool exists = false;
+        if (!in.is_open() && readOnly)
+            std::cerr << "Error while opening file " << pathToFile << " to read" << std::endl;
+        if (in.is_open()) {
+            char magic[ sizeof(MAGIC) ] = {};
+            in.read( magic, sizeof(magic) );
+            exists = in.gcount() != 0;
+            if (exists && (in.gcount() != sizeof(magic) || std::memcmp( magic, MAGIC, sizeof(magic) ) != 0)) {
+                std::cerr << "File " << pathToFile << " is not a result store"
+                          << (readOnly ? "" : ", results are not saved") << std::endl;
+                return;
+            }
+            Record record;
+            while (in.read( reinterpret_cast<char*>( &record ), sizeof(record) ) && record.checksum == checksum( record ))
+                records_.push_back( record );
+            in.close();
+        }
+        if (readOnly)
+            return;
+        // Cut a torn or damaged tail, so new records follow the last valid one.
+        if (exists)
+            std::filesystem::resize_file( pathToFile, sizeof(MAGIC) + records_.size() * sizeof(Record) );
+        out_.open( pathToFile, std::ios::binary | std::ios::app );
+        if (!out_.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return;
+        }
+        if (!exists)
+            out_.write( MAGIC, sizeof(MAGIC) );
+        out_.flush();
+    }
+
+
+    // Returns all valid records in the order they were appended.
+    const std::vector<Record>& getRecords() const
+    {
+        return records_;
+    }
+
+
+    /**
+     * Find the record of a point.
+     *
+     * @param configurationHash is a hash of the sweep configuration.
+     * @param modulationOrder is a modulation order of the point.
+     * @param SNR is an SNR value of the point.
+     * @return pointer to the latest such record or nullptr.
+     */
+    const Record* find(std::uint64_t configurationHash, int modulationOrder, double SNR) const
+    {
+        for (std::size_t i = records_.size(); i-- > 0; )
+            if (records_[i].configurationHash == configurationHash && records_[i].modulationOrder == modulationOrder
+                && records_[i].SNR == SNR)
+                return &records_[i];
+        return nullptr;
+    }
+
+
+    // Appends a record and flushes it to the file.
+    void append(Record record)
+    {
+        record.checksum = checksum( record );
+        records_.push_back( record );
+        if (!out_.is_open())
+            return;
+        out_.write( reinterpret_cast<const char*>( &record ), sizeof(record) );
+        out_.flush();
+    }
+
+
+    /**
+     * Export all records to CSV, one record per line.
+     *
+     * @param pathToFile is a path to the file in text (string) format.
+     */
+    void writeCsv(const std::string& pathToFile) const
+    {
+        std::ofstream out( pathToFile );
+        if (!out.is_open()) {
+            std::cerr << "Error while opening file to write" << std::endl;
+            return;
+        }
+        out << "configuration,order,SNR,seed,errors,bits,trials,BER" << std::endl;
+        for (const Record& i : records_)
+            out << std::hex << i.configurationHash << std::dec << ',' << i.modulationOrder << ',' << i.SNR << ','
+                << i.seed << ',' << i.errors << ',' << i.bits << ',' << i.trials << ','
+                << (i.bits ? (i.flags & IMPORTANCE_SAMPLING ? i.weightedErrors : i.errors) / double( i.bits ) : 0) << std::endl;
+    }
+
+
+    // FNV-1a hash of bytes, also used for configuration hashes.
+    static std::uint64_t hashBytes(const void* data, std::size_t n, std::uint64_t hash = 0xCBF29CE484222325ull)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>( data );
+        for (std::size_t i = 0; i < n; i++)
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        return hash;
+    }
+
+
+
+private:
+
+
+    static constexpr char MAGIC[8] = { 'G', 'C', 'R', 'S', 'T', 'O', 'R', '1' };
+
+
+    static std::uint64_t checksum(const Record& record)
+    {
+        return hashBytes( &record, offsetof( Record, checksum ) );
+    }
+
+
+
+    std::string         pathToFile_;
+    std::vector<Record> records_;
+    std::ofstream       out_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_RESULTSTORE_H
@@ -0,0 +1,179 @@
+// This class is a bounded lock-free queue of one producer thread and one
+// consumer thread. Head and tail indices live in their own cache lines and
+// each side keeps a cached copy of the other's index, so a push or a pop
+// touches shared memory only when the cached view says the ring is full or
+// empty. A full ring makes the producer wait (backpressure), an empty one
+// makes the consumer wait: both spin for a while and then sleep in
+// std::atomic::wait until the other side moves its index. A side raises
+// its waiting flag before it sleeps and the other side notifies only if
+// the flag is up, so a block exchange makes no call to wake anyone while
+// neither side sleeps. The producer
+// also samples occupancy of the ring every OCCUPANCY_PERIOD pushes: the
+// sample reads the consumer's index, so it refreshes the cached copy too,
+// and the other pushes stay off the consumer's cache line.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SPSCRING_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SPSCRING_H
+
+
+// Counters of a ring, every one is written by one side only.
+struct SpscRingStatistics {
+    std::uint64_t pushes        = 0;
+    std::uint64_t samples       = 0;    // Pushes which sampled occupancy.
+    std::uint64_t occupancy     = 0;    // Sum of elements in the ring before every sample.
+    std::uint64_t fullWaits     = 0;    // Pushes which found the ring full.
+    std::uint64_t emptyWaits    = 0;    // Pops which found the ring empty.
+};
+
+
+template <typename T>
+class SpscRing {
+public:
+
+
+    using Statistics = SpscRingStatistics;
+
+
+    /**
+     * Create an empty ring.
+     *
+     * @param capacity is a number of elements, rounded up to a power of two.
+     */
+    explicit SpscRing(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        slots_.resize( size );
+        mask_ = size - 1;
+    }
+
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+
+    std::size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+
+    /**
+     * Append an element, waiting while the ring is full. Producer only.
+     *
+     * @param value is an element to append.
+     */
+    void push(const T& value)
+    {
+        std::size_t tail = tail_.load( std::memory_order_relaxed );
+        if (tail - cachedHead_ == slots_.size()) {
+            cachedHead_ = head_.load( std::memory_order_acquire );
+            if (tail - cachedHead_ == slots_.size()) {
+                statistics_.fullWaits++;
+                cachedHead_ = waitWhile( head_, tail - slots_.size(), producerWaiting_ );
+            }
+        }
+        if (statistics_.pushes++ % OCCUPANCY_PERIOD == 0) {
+            cachedHead_ = head_.load( std::memory_order_acquire );
+            statistics_.samples++;
+            statistics_.occupancy += tail - cachedHead_;
+        }
+        slots_[ tail & mask_ ] = value;
+        tail_.store( tail + 1, std::memory_order_seq_cst );
+        if (consumerWaiting_.load( std::memory_order_seq_cst ))
+            tail_.notify_one();
+    }
+
+
+    /**
+     * Take the oldest element, waiting while the ring is empty. Consumer only.
+     *
+     * @return element.
+     */
+    T pop()
+    {
+        std::size_t head = head_.load( std::memory_order_relaxed );
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load( std::memory_order_acquire );
+            if (head == cachedTail_) {
+                consumerStatistics_.emptyWaits++;
+                cachedTail_ = waitWhile( tail_, head, consumerWaiting_ );
+            }
+        }
+        T value = slots_[ head & mask_ ];
+        head_.store( head + 1, std::memory_order_seq_cst );
+        if (producerWaiting_.load( std::memory_order_seq_cst ))
+            head_.notify_one();
+        return value;
+    }
+
+
+    // Returns counters of both sides. Call when neither side is running.
+    Statistics getStatistics() const
+    {
+        Statistics statistics = statistics_;
+        statistics.emptyWaits = consumerStatistics_.emptyWaits;
+        return statistics;
+    }
+
+
+
+private:
+
+
+    /**
+     * Spin, then sleep until index differs from value. The flag is raised
+     * before the index is checked for the last time and the other side
+     * stores its index before it reads the flag (all sequentially
+     * consistent), so either the check sees the new index or the other
+     * side sees the flag and notifies.
+     *
+     * @param index is an index of the other side.
+     * @param value is a value to wait out.
+     * @param waiting is a waiting flag of this side.
+     * @return new value of index.
+     */
+    static std::size_t waitWhile(const std::atomic<std::size_t>& index, std::size_t value, std::atomic<bool>& waiting)
+    {
+        for (int i = 0; i < SPINS; i++) {
+            std::size_t current = index.load( std::memory_order_acquire );
+            if (current != value)
+                return current;
+        }
+        waiting.store( true, std::memory_order_seq_cst );
+        index.wait( value, std::memory_order_seq_cst );
+        waiting.store( false, std::memory_order_relaxed );
+        return index.load( std::memory_order_acquire );
+    }
+
+
+    static constexpr int            SPINS               = 1024;
+    static constexpr std::uint64_t  OCCUPANCY_PERIOD    = 8;
+
+
+
+    alignas(64) std::atomic<std::size_t>    head_       = 0;    // Next element to pop.
+    std::atomic<bool>                       producerWaiting_    = false;    // Producer sleeps on head_.
+    alignas(64) std::atomic<std::size_t>    tail_       = 0;    // Next slot to push.
+    std::atomic<bool>                       consumerWaiting_    = false;    // Consumer sleeps on tail_.
+    // Producer side.
+    alignas(64) std::size_t                 cachedHead_ = 0;
+    Statistics                              statistics_;
+    // Consumer side.
+    alignas(64) std::size_t                 cachedTail_ = 0;
+    Statistics                              consumerStatistics_;
+    alignas(64) std::vector<T>              slots_;
+    std::size_t                             mask_       = 0;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SPSCRING_H
@@ -0,0 +1,79 @@
+// Client of the sweep server (--serve of the console app, see
+// SweepServer.h). Sends its options as one job and prints the reply
+// lines as they come.
+//
+// Options: --socket=PATH (default ./GaussianChannel.sock), every other
+// option goes to the job, e.g. --orders=4,16 --snr=0,2,4 --trials=50
+// --seed=7; --shutdown stops the server.
+// Exit code is 0 if the job is done, 1 otherwise.
+
+#include <cerrno>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Instruments.h"
+
+
+int main(int argc, char* argv[]) {
+    Instruments InstrumentsObj;
+    std::map<std::string, std::string> options = InstrumentsObj.parseArguments( argc, argv );
+    std::string pathToSocket = options.count( "socket" ) ? options["socket"] : "./GaussianChannel.sock";
+    options.erase( "socket" );
+
+    std::string job;
+    for (const auto& [key, value] : options)
+        job += "--" + key + "=" + value + " ";
+    job += '\n';
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (pathToSocket.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << pathToSocket << " is too long" << std::endl;
+        return 1;
+    }
+    pathToSocket.copy( address.sun_path, pathToSocket.size() );
+    int connection = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if (connection < 0 || connect( connection, reinterpret_cast<sockaddr*>( &address ), sizeof(address) ) != 0) {
+        std::cerr << "Cannot connect to " << pathToSocket << ", is the server started with --serve?" << std::endl;
+        return 1;
+    }
+    for (std::size_t sent = 0; sent < job.size(); ) {
+        ssize_t n = send( connection, job.data() + sent, job.size() - sent, MSG_NOSIGNAL );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            std::cerr << "Error while sending job" << std::endl;
+            close( connection );
+            return 1;
+        }
+        sent += n;
+    }
+
+    // Print lines as they come, the last one tells how the job ended.
+    std::string line;
+    std::string lastLine;
+    char        buffer[4096];
+    for (;;) {
+        ssize_t n = recv( connection, buffer, sizeof(buffer), 0 );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i] != '\n') {
+                line += buffer[i];
+                continue;
+            }
+            std::cout << line << std::endl;
+            lastLine = line;
+            line.clear();
+        }
+    }
+    close( connection );
+    return lastLine.rfind( "done", 0 ) == 0 ? 0 : 1;
+}
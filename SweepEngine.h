@@ -0,0 +1,685 @@
+// This class runs Monte Carlo BER sweeps over a grid of modulation
+// orders, SNR values and trials. Every (order, SNR, trial) triple is an
+// independent work item executed on a work-stealing thread pool. Noise
+// of every item is its own stream of the global seed, so the result does
+// not depend on the number of threads or on the order of execution.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "AsyncPipeline.h"
+#include "BitStream.h"
+#include "BufferArena.h"
+#include "ConvolutionalCode.h"
+#include "FusedPipeline.h"
+#include "NoiseGenerator.h"
+#include "PayloadSource.h"
+#include "Profiler.h"
+#include "PulseShaper.h"
+#include "ResultStore.h"
+#include "ThreadPool.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPENGINE_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPENGINE_H
+
+
+// Grid of the experiment.
+struct SweepParameters {
+    std::vector<double>     SNR;
+    std::vector<int>        modulationOrders;
+    int                     nExperiments    = 100;
+    std::uint64_t           seed            = 1;
+    NoiseGenerator::Source  noiseSource     = NoiseGenerator::PHILOX;
+    bool                    fused           = true;     // FusedPipeline instead of separate stages.
+    // Adaptive mode: run trials of a point until targetErrors errors or
+    // maxBits bits, nExperiments is not used.
+    bool                    adaptive        = false;
+    std::uint64_t           targetErrors    = 100;
+    std::uint64_t           maxBits         = 100000000;
+    double                  confidenceZ     = 1.959964;     // 95% two-sided.
+    // Importance sampling (always fused). In adaptive mode a point stops when
+    // relative standard error reaches that of targetErrors plain errors.
+    bool                    importanceSampling = false;
+    // Common random numbers: one unit noise sequence per trial is scaled by
+    // sigma of every SNR point (always fused, not with importance sampling),
+    // optionally the same sequence for all orders too.
+    bool                    commonNoise     = false;
+    bool                    commonNoiseAcrossOrders = false;
+    // Fading before the noise (always fused, not with importance sampling
+    // or common noise).
+    FadingParameters        fading;
+    // Convolutional code with hard or soft decoding (staged chain, not with
+    // importance sampling, common noise or fading). SNR is Eb/N0 of data
+    // bits, so the channel gets SNR + 10 log10(rate).
+    ConvolutionalCode::Decision code = ConvolutionalCode::NONE;
+    // RRC pulse shaping and matched filter (staged chain, not with importance
+    // sampling, common noise or fading). Noise is added to every sample.
+    PulseShapingParameters  pulseShaping;
+    // Samples of the fused chain (plain or common noise) in single precision
+    // (always fused, not with importance sampling, fading, code or shaping).
+    FusedPipeline::Precision precision = FusedPipeline::DOUBLE;
+    // Stages of a trial on their own threads (AsyncPipeline), trials one
+    // after another: for a few long trials. Same results as fused chain
+    // (plain double precision AWGN only).
+    bool                    pipelined       = false;
+    // ADC of the receiver: quantized samples and integer slicer (fused
+    // chain, plain double precision AWGN only).
+    AdcParameters           adc;
+    // Hybrid mode: points to simulate, point index is order index * number
+    // of SNR values + SNR index. Empty means all. Other points are done
+    // without trials (the caller takes their BER from TheoreticalBER).
+    std::vector<bool>       simulated;
+    // Sharding: this process runs only units of the grid with index
+    // shardIndex modulo shardCount. A unit is a block of shardTrialBlock
+    // trials of a point (of a group with common noise); in adaptive mode,
+    // where trials of a point depend on each other, a unit is a whole point.
+    unsigned                shardIndex      = 0;
+    unsigned                shardCount      = 1;
+    std::uint64_t           shardTrialBlock = 16;
+};
+
+
+// Result of one (order, SNR) point.
+struct SweepPoint {
+    int                     modulationOrder = 0;
+    double                  SNR             = 0;
+    std::uint64_t           errors          = 0;
+    std::uint64_t           bits            = 0;
+    std::uint64_t           trials          = 0;
+    double                  BER             = 0;
+    double                  lower           = 0;    // Confidence interval of BER.
+    double                  upper           = 0;
+    // Importance sampling: sums of weighted errors of trials and of their squares.
+    double                  weightedErrors          = 0;
+    double                  weightedErrorsSquared   = 0;
+};
+
+
+class SweepEngine {
+public:
+
+
+    /**
+     * Create engine with its own pool of workers.
+     *
+     * @param nThreads is a number of workers. Zero means one worker
+     * per hardware thread.
+     */
+    explicit SweepEngine(unsigned nThreads = 0)
+        : pool_( nThreads )
+    {
+    }
+
+
+    // Returns number of workers.
+    unsigned getNumberOfThreads() const
+    {
+        return pool_.size();
+    }
+
+
+    /**
+     * Run the whole sweep.
+     *
+     * Trials are done in rounds. Every round plans a number of new trials
+     * for every unfinished point, runs all of them in parallel and then
+     * accumulates them in trial order. In adaptive mode a point stops at the
+     * first trial which reaches the error target or the bit budget, trials
+     * after it are dropped. Plans depend only on accumulated counts, so the
+     * result does not depend on the number of threads. Without a listener
+     * all trials of the fixed mode are one round; with it a round takes
+     * groups of points until there are a few items per worker, so points
+     * finish one after another (with the same results).
+     *
+     * @param parameters is a grid of the experiment.
+     * @param inputData is a data to transmit: BitStream or PayloadSource
+     * (any type with size(), empty(), read(position, nBits) and
+     * toBitStream()). Staged chain copies it into a BitStream first.
+     * @param store is a store of finished points or nullptr. Points which
+     * have a record of the same configuration are not run again, every
+     * point is appended to the store as soon as it is finished.
+     * @param listener is called with the estimate of every point as soon
+     * as it is finished (or taken from the store), on the calling thread.
+     * @return one result per (order, SNR) point, SNR is the fastest
+     * changing index.
+     */
+    template <typename Source>
+    std::vector<SweepPoint> run(const SweepParameters& parameters, const Source& inputData, ResultStore* store = nullptr,
+                                const std::function<void(const SweepPoint&)>& listener = nullptr)
+    {
+        std::size_t nOrders = parameters.modulationOrders.size();
+        std::size_t nSNR    = parameters.SNR.size();
+        std::size_t nPoints = nOrders * nSNR;
+
+        bool coded = parameters.code != ConvolutionalCode::NONE && !parameters.importanceSampling;
+        bool faded = parameters.fading.model != FadingParameters::NONE && !parameters.importanceSampling && !coded;
+        bool shaped = parameters.pulseShaping.enabled && !parameters.importanceSampling && !faded;
+        bool single = isSinglePrecision( parameters );
+        bool quantized = isQuantized( parameters );
+        bool pipelined = parameters.pipelined && !parameters.importanceSampling && !faded && !coded && !shaped && !single
+                       && !parameters.commonNoise && !quantized;
+        bool fused = !coded && !shaped
+                   && (parameters.fused || parameters.importanceSampling || faded || single || pipelined || quantized);
+
+        // Validate orders. Staged chain also modulates (and shapes) data
+        // once per order (coded data if there is a code), workers only read it.
+        BitStream                                       copy;
+        const BitStream&                                stagedData = asBitStream( inputData, copy, !fused );
+        BitStream                                       encoded;
+        if (coded)
+            encoded = ConvolutionalCode::encode( stagedData );
+        std::vector<int>                                modulationOrders( nOrders );
+        std::vector<std::vector<std::complex<int> > >   dataModulated( nOrders );
+        std::vector<std::vector<std::complex<double> > > waveforms( nOrders );
+        qamModulator QAMmodulatorObj;
+        PulseShaper  PulseShaperObj( parameters.pulseShaping );
+        for (std::size_t k = 0; k < nOrders; k++) {
+            int modulationOrder = parameters.modulationOrders[k];
+            QAMmodulatorObj.setModulationOrder( modulationOrder );
+            modulationOrders[k] = QAMmodulatorObj.getModulationOrder();
+            if (!fused)
+                dataModulated[k] = QAMmodulatorObj.modulateData( coded ? encoded : stagedData );
+            if (shaped)
+                waveforms[k] = PulseShaperObj.shape( dataModulated[k] );
+        }
+
+        // Every worker owns a channel and a demodulator per order. Workers
+        // stay from run to run, so their buffers are already allocated.
+        workers_.resize( pool_.size() );
+        for (WorkerState& w : workers_) {
+            w.channels.resize( nOrders );
+            w.demodulators.resize( nOrders );
+            for (std::size_t k = 0; k < nOrders; k++) {
+                w.channels[k].setModulationOrder( modulationOrders[k] );
+                w.channels[k].setNoiseSource( parameters.noiseSource );
+                w.channels[k].setFading( parameters.fading );
+                w.demodulators[k].setModulationOrder( modulationOrders[k] );
+            }
+            if (shaped)
+                w.shaper.setParameters( parameters.pulseShaping );
+            w.pipeline.setPrecision( single ? FusedPipeline::SINGLE : FusedPipeline::DOUBLE );
+            w.pipeline.setAdc( quantized ? parameters.adc : AdcParameters() );
+        }
+
+        // Staged chain: noise on symbols, or on the waveform followed by
+        // the matched filter. Buffers of a trial come from the arena of the
+        // worker.
+        auto addNoise = [&](WorkerState& w, std::size_t k, double SNR) {
+            std::span<std::complex<double> > symbols = w.arena.allocate<std::complex<double> >( dataModulated[k].size() );
+            if (!shaped) {
+                w.channels[k].addGaussianNoise( std::span<const std::complex<int> >( dataModulated[k] ), SNR, symbols );
+                return symbols;
+            }
+            std::span<std::complex<double> > waveform = w.arena.allocate<std::complex<double> >( waveforms[k].size() );
+            w.channels[k].addGaussianNoise( std::span<const std::complex<double> >( waveforms[k] ), SNR, waveform );
+            w.shaper.receive( waveform, symbols );
+            return symbols;
+        };
+
+        std::vector<SweepPoint> points( nPoints );
+        for (std::size_t point = 0; point < nPoints; point++) {
+            points[ point ].modulationOrder = modulationOrders[ point / nSNR ];
+            points[ point ].SNR             = parameters.SNR[ point % nSNR ];
+        }
+        std::vector<bool> done( nPoints, inputData.empty() );
+        for (std::size_t point = 0; point < nPoints && point < parameters.simulated.size(); point++)
+            if (!parameters.simulated[ point ])
+                done[ point ] = true;
+
+        // Take finished points from the store.
+        std::uint64_t configurationHash = store ? configurationHashOf( parameters, inputData ) : 0;
+        for (std::size_t point = 0; store && point < nPoints; point++) {
+            SweepPoint& p = points[ point ];
+            const ResultStore::Record* record = store->find( configurationHash, p.modulationOrder, p.SNR );
+            if (record == nullptr)
+                continue;
+            p.errors                = record->errors;
+            p.bits                  = record->bits;
+            p.trials                = record->trials;
+            p.weightedErrors        = record->weightedErrors;
+            p.weightedErrorsSquared = record->weightedErrorsSquared;
+            done[ point ] = true;
+            if (listener)
+                listener( estimated( parameters, p ) );
+        }
+
+        // A trial is done for a group of points: a single point, or all SNR
+        // points of an order with common noise.
+        bool                        common      = parameters.commonNoise && !parameters.importanceSampling && !faded && !coded
+                                                && !shaped;
+        std::size_t                 groupSize   = common ? nSNR : 1;
+        std::vector<std::uint64_t>  groupTrials( nPoints / groupSize );
+
+        // Points of other shards are done from the start.
+        std::uint64_t block = std::max<std::uint64_t>( parameters.shardTrialBlock, 1 );
+        for (std::size_t group = 0; parameters.shardCount > 1 && group < groupTrials.size(); group++) {
+            bool owned = false;
+            for (std::uint64_t j = 0; j < planTrials( parameters, SweepPoint(), 1 ) && !owned; j += block)
+                owned = ownsTrial( parameters, group, j );
+            if (!owned)
+                std::fill( done.begin() + group * groupSize, done.begin() + (group + 1) * groupSize, true );
+        }
+
+        while (std::find( done.begin(), done.end(), false ) != done.end()) {
+            // Plan the round: item is (group, trial). A group gets the largest
+            // number of trials planned for its unfinished points.
+            std::vector<std::pair<std::size_t, std::uint64_t> > items;
+            std::vector<bool>                                   planned( groupTrials.size() );
+            for (std::size_t group = 0; group < groupTrials.size(); group++) {
+                if (!parameters.adaptive && listener && items.size() >= ROUND_ITEMS_PER_WORKER * pool_.size())
+                    break;
+                planned[ group ] = true;
+                std::uint64_t nNew = 0;
+                for (std::size_t point = group * groupSize; point < (group + 1) * groupSize; point++)
+                    if (!done[ point ])
+                        nNew = std::max( nNew, planTrials( parameters, points[ point ], inputData.size() ) );
+                for (std::uint64_t j = groupTrials[ group ]; j < groupTrials[ group ] + nNew; j++)
+                    if (ownsTrial( parameters, group, j ))
+                        items.emplace_back( group, j );
+                groupTrials[ group ] += nNew;
+            }
+
+            Profiler::addPlannedWork( items.size() );
+
+            // Each item writes its own slots, so no locking is needed.
+            std::vector<std::uint64_t> trialErrors( items.size() * groupSize );
+            std::vector<double>        trialWeightedErrors( items.size() * groupSize );
+            auto runItem = [&](std::size_t item, unsigned workerId) {
+                std::size_t     point = items[ item ].first * groupSize;
+                std::uint64_t   j     = items[ item ].second;
+                std::size_t     i     = point % nSNR;
+                std::size_t     k     = point / nSNR;
+                WorkerState& w = workers_[ workerId ];
+                int bitsPerSymbol = w.channels[k].getConstellationTable().getBitsPerSymbol();
+                Profiler::WorkScope profile( (inputData.size() + bitsPerSymbol - 1) / bitsPerSymbol );
+                if (common) {
+                    w.channels[k].setSeed( parameters.seed, trialStream( parameters.commonNoiseAcrossOrders ? 0 : k, 0, j ) );
+                    w.pipeline.countErrorsCommonNoise( inputData, w.channels[k], parameters.SNR,
+                                                       std::span<std::uint64_t>( trialErrors ).subspan( item * groupSize, groupSize ) );
+                    return;
+                }
+                w.channels[k].setSeed( parameters.seed, trialStream( k, i, j ) );
+                if (parameters.importanceSampling) {
+                    trialErrors[ item ] = w.pipeline.countWeightedErrors( inputData, w.channels[k], parameters.SNR[i],
+                                                                          trialWeightedErrors[ item ] );
+                    return;
+                }
+                if (pipelined) {
+                    trialErrors[ item ] = w.asyncPipeline.countErrors( inputData, w.channels[k], parameters.SNR[i] );
+                    return;
+                }
+                if (fused) {
+                    trialErrors[ item ] = w.pipeline.countErrors( inputData, w.channels[k], parameters.SNR[i] );
+                    return;
+                }
+                w.arena.reset();
+                if (coded) {
+                    double SNR = parameters.SNR[i] + 10 * std::log10( ConvolutionalCode::RATE );
+                    std::span<std::complex<double> > dataNoised = addNoise( w, k, SNR );
+                    if (parameters.code == ConvolutionalCode::SOFT) {
+                        std::span<float> LLRs = w.arena.allocate<float>( dataNoised.size() * std::bit_width( unsigned( modulationOrders[k] ) - 1 ) );
+                        w.demodulators[k].demodulateData( dataNoised, w.channels[k].getNoiseDeviation( SNR ), LLRs );
+                        w.code.decode( std::span<const float>( LLRs ).first( encoded.size() ), w.decoded );
+                    }
+                    else {
+                        w.demodulators[k].demodulateData( dataNoised, modulationOrders[k], w.arena.allocate<int>( dataNoised.size() ), w.demodulated );
+                        w.code.decode( w.demodulated, encoded.size(), w.decoded );
+                    }
+                    Profiler::Scope countProfile( Profiler::COUNT, dataNoised.size() );
+                    trialErrors[ item ] = stagedData.countDifferences( w.decoded, stagedData.size() );
+                    return;
+                }
+                std::span<std::complex<double> > dataNoised = addNoise( w, k, parameters.SNR[i] );
+                w.demodulators[k].demodulateData( dataNoised, modulationOrders[k], w.arena.allocate<int>( dataNoised.size() ), w.demodulated );
+                Profiler::Scope countProfile( Profiler::COUNT, dataNoised.size() );
+                trialErrors[ item ] = stagedData.countDifferences( w.demodulated, stagedData.size() );
+            };
+            // Pipelined trials go one after another to the stage threads of
+            // the first worker, which take a core per stage.
+            if (pipelined)
+                for (std::size_t item = 0; item < items.size(); item++)
+                    runItem( item, 0 );
+            else
+                pool_.parallelFor( items.size(), 1, runItem );
+
+            // Accumulate in trial order (items of a group are consecutive).
+            std::vector<bool> wasDone = done;
+            for (std::size_t item = 0; item < items.size() * groupSize; item++) {
+                std::size_t point = items[ item / groupSize ].first * groupSize + item % groupSize;
+                if (done[ point ])
+                    continue;
+                SweepPoint& p = points[ point ];
+                p.errors += trialErrors[ item ];
+                p.bits   += inputData.size();
+                p.trials++;
+                p.weightedErrors        += trialWeightedErrors[ item ];
+                p.weightedErrorsSquared += trialWeightedErrors[ item ] * trialWeightedErrors[ item ];
+                if (!parameters.adaptive)
+                    done[ point ] = p.trials >= std::uint64_t( std::max( parameters.nExperiments, 0 ) );
+                else if (parameters.importanceSampling)
+                    done[ point ] = isPrecise( parameters, p ) || p.bits >= parameters.maxBits;
+                else
+                    done[ point ] = p.errors >= parameters.targetErrors || p.bits >= parameters.maxBits;
+            }
+            // Fixed mode plans all trials of a group at once (trials of other
+            // shards are not run).
+            for (std::size_t point = 0; !parameters.adaptive && point < nPoints; point++)
+                if (planned[ point / groupSize ])
+                    done[ point ] = true;
+
+            for (std::size_t point = 0; (store || listener) && point < nPoints; point++) {
+                if (wasDone[ point ] || !done[ point ])
+                    continue;
+                const SweepPoint& p = points[ point ];
+                if (listener)
+                    listener( estimated( parameters, p ) );
+                if (!store)
+                    continue;
+                ResultStore::Record record;
+                record.configurationHash     = configurationHash;
+                record.modulationOrder       = p.modulationOrder;
+                record.flags                 = parameters.importanceSampling ? ResultStore::IMPORTANCE_SAMPLING : 0;
+                record.SNR                   = p.SNR;
+                record.seed                  = parameters.seed;
+                record.errors                = p.errors;
+                record.bits                  = p.bits;
+                record.trials                = p.trials;
+                record.weightedErrors        = p.weightedErrors;
+                record.weightedErrorsSquared = p.weightedErrorsSquared;
+                store->append( record );
+            }
+        }
+
+        for (SweepPoint& p : points)
+            estimate( parameters, p );
+        return points;
+    }
+
+
+    /**
+     * Hash of everything which defines results of a sweep: grid, seed,
+     * stopping rule, noise and a sample of the payload (its size and 64
+     * words spread over it).
+     *
+     * @param parameters is a grid of the experiment.
+     * @param inputData is a data to transmit.
+     * @return configuration hash for the result store.
+     */
+    template <typename Source>
+    static std::uint64_t configurationHashOf(const SweepParameters& parameters, const Source& inputData)
+    {
+        std::uint64_t hash = ResultStore::hashBytes( parameters.SNR.data(), parameters.SNR.size() * sizeof(double) );
+        hash = ResultStore::hashBytes( parameters.modulationOrders.data(), parameters.modulationOrders.size() * sizeof(int), hash );
+        bool coded = parameters.code != ConvolutionalCode::NONE && !parameters.importanceSampling;
+        bool faded = parameters.fading.model != FadingParameters::NONE && !parameters.importanceSampling && !coded;
+        bool shaped = parameters.pulseShaping.enabled && !parameters.importanceSampling && !faded;
+        std::uint64_t values[] = {
+            parameters.SNR.size(), parameters.modulationOrders.size(),
+            parameters.adaptive ? 0 : std::uint64_t( parameters.nExperiments ), parameters.seed,
+            std::uint64_t( parameters.noiseSource ), parameters.adaptive,
+            parameters.adaptive ? parameters.targetErrors : 0, parameters.adaptive ? parameters.maxBits : 0,
+            parameters.importanceSampling, parameters.commonNoise && !parameters.importanceSampling && !faded && !coded && !shaped,
+            parameters.commonNoiseAcrossOrders, inputData.size()
+        };
+        hash = ResultStore::hashBytes( values, sizeof(values), hash );
+        if (coded) {
+            std::uint64_t code = parameters.code;
+            hash = ResultStore::hashBytes( &code, sizeof(code), hash );
+        }
+        if (faded) {
+            const FadingParameters& fading = parameters.fading;
+            std::uint64_t fadingValues[] = { std::uint64_t( fading.model ), std::bit_cast<std::uint64_t>( fading.ricianFactor ),
+                                             fading.blockSymbols, std::uint64_t( fading.equalizer ) };
+            hash = ResultStore::hashBytes( fadingValues, sizeof(fadingValues), hash );
+        }
+        if (isSinglePrecision( parameters )) {
+            std::uint64_t precision = parameters.precision;
+            hash = ResultStore::hashBytes( &precision, sizeof(precision), hash );
+        }
+        if (isQuantized( parameters )) {
+            const AdcParameters& adc = parameters.adc;
+            std::uint64_t adcValues[] = { std::uint64_t( adc.bits ), std::bit_cast<std::uint64_t>( adc.fullScale ),
+                                          adc.agc };
+            hash = ResultStore::hashBytes( adcValues, sizeof(adcValues), hash );
+        }
+        if (shaped) {
+            const PulseShapingParameters& pulse = parameters.pulseShaping;
+            std::uint64_t pulseValues[] = { std::bit_cast<std::uint64_t>( pulse.rolloff ), std::uint64_t( pulse.span ),
+                                            std::uint64_t( pulse.oversampling ) };
+            hash = ResultStore::hashBytes( pulseValues, sizeof(pulseValues), hash );
+        }
+        // Shards of a sweep share the hash, so their records can be merged.
+        if (parameters.shardCount > 1) {
+            std::uint64_t shards[] = { parameters.shardCount, parameters.adaptive ? 0 : parameters.shardTrialBlock };
+            hash = ResultStore::hashBytes( shards, sizeof(shards), hash );
+        }
+        for (std::uint64_t i = 0; i < 64 && !inputData.empty(); i++) {
+            std::uint64_t word = inputData.read( inputData.size() / 64 * i, 64 );
+            hash = ResultStore::hashBytes( &word, sizeof(word), hash );
+        }
+        return hash;
+    }
+
+
+    /**
+     * Number of trials to add to a point in the next round. Fixed mode
+     * does all trials at once. Adaptive mode starts with one trial, then
+     * extrapolates the error rate to the target (at most 8 times more
+     * trials than done), and grows 4 times while there are no errors.
+     *
+     * @param parameters is a grid of the experiment.
+     * @param point is an accumulated result of the point.
+     * @param bitsPerTrial is a number of bits in one trial.
+     * @return number of new trials.
+     */
+    static std::uint64_t planTrials(const SweepParameters& parameters, const SweepPoint& point, std::uint64_t bitsPerTrial)
+    {
+        if (!parameters.adaptive)
+            return std::max( parameters.nExperiments, 0 );
+        std::uint64_t nNew;
+        if (parameters.importanceSampling) {
+            // Enough trials to estimate variance, then trials needed for the precision.
+            double mean = point.trials > 0 ? point.weightedErrors / point.trials : 0;
+            if (point.trials < MIN_IMPORTANCE_TRIALS)
+                nNew = MIN_IMPORTANCE_TRIALS - point.trials;
+            else if (mean <= 0)
+                nNew = 4 * point.trials;
+            else {
+                double variance = standardError( point ) * standardError( point ) * point.trials;
+                double needed   = std::ceil( variance / (mean * mean) * parameters.targetErrors ) - point.trials;
+                nNew = std::min<double>( std::max( needed, 1.0 ), 8.0 * point.trials );
+            }
+        }
+        else if (point.trials == 0)
+            nNew = 1;
+        else if (point.errors == 0)
+            nNew = 4 * point.trials;
+        else {
+            double errorsPerTrial = point.errors / (double)point.trials;
+            double needed         = std::ceil( (parameters.targetErrors - point.errors) / errorsPerTrial );
+            nNew = std::min<double>( needed, 8.0 * point.trials );
+        }
+        std::uint64_t budget = point.bits < parameters.maxBits
+                             ? (parameters.maxBits - point.bits + bitsPerTrial - 1) / bitsPerTrial : 0;
+        return std::clamp<std::uint64_t>( nNew, 1, std::max<std::uint64_t>( budget, 1 ) );
+    }
+
+
+    // Standard error of the mean weighted errors per trial.
+    static double standardError(const SweepPoint& point)
+    {
+        if (point.trials < 2)
+            return 0;
+        double n        = point.trials;
+        double mean     = point.weightedErrors / n;
+        double variance = std::max( 0.0, (point.weightedErrorsSquared - n * mean * mean) / (n - 1) );
+        return std::sqrt( variance / n );
+    }
+
+
+    // Returns true if relative standard error of importance sampling
+    // estimate is not worse than that of targetErrors plain errors.
+    static bool isPrecise(const SweepParameters& parameters, const SweepPoint& point)
+    {
+        if (point.trials < MIN_IMPORTANCE_TRIALS || point.weightedErrors <= 0)
+            return false;
+        double relativeError = standardError( point ) * point.trials / point.weightedErrors;
+        return relativeError * relativeError * parameters.targetErrors <= 1;
+    }
+
+
+    // Sets BER and its confidence interval of an accumulated point.
+    static void estimate(const SweepParameters& parameters, SweepPoint& p)
+    {
+        if (p.bits == 0)
+            return;
+        if (parameters.importanceSampling) {
+            // Normal interval over trials, estimates of trials are independent.
+            p.BER = p.weightedErrors / p.bits;
+            double error = parameters.confidenceZ * standardError( p ) * p.trials / p.bits;
+            p.lower = std::max( 0.0, p.BER - error );
+            p.upper = p.BER + error;
+            return;
+        }
+        Instruments InstrumentsObj;
+        p.BER = p.errors / (double)p.bits;
+        std::pair<double, double> interval = InstrumentsObj.computeConfidenceInterval( p.errors, p.bits, parameters.confidenceZ );
+        p.lower = interval.first;
+        p.upper = interval.second;
+    }
+
+
+    // Returns true if TheoreticalBER gives the BER of the sweep: uncoded
+    // chain without fading, pulse shaping and ADC.
+    static bool hasTheory(const SweepParameters& parameters)
+    {
+        return parameters.code == ConvolutionalCode::NONE && parameters.fading.model == FadingParameters::NONE
+            && !parameters.pulseShaping.enabled && parameters.adc.bits == 0;
+    }
+
+
+    // Returns true if samples of the sweep are in single precision.
+    static bool isSinglePrecision(const SweepParameters& parameters)
+    {
+        return parameters.precision == FusedPipeline::SINGLE && !parameters.importanceSampling
+            && parameters.code == ConvolutionalCode::NONE && parameters.fading.model == FadingParameters::NONE
+            && !parameters.pulseShaping.enabled;
+    }
+
+
+    // Returns true if samples of the sweep go through the ADC.
+    static bool isQuantized(const SweepParameters& parameters)
+    {
+        return parameters.adc.bits != 0 && !parameters.importanceSampling && parameters.code == ConvolutionalCode::NONE
+            && parameters.fading.model == FadingParameters::NONE && !parameters.pulseShaping.enabled
+            && !isSinglePrecision( parameters ) && !parameters.commonNoise;
+    }
+
+
+    /**
+     * Check if a trial belongs to this shard. Units of the grid are dealt
+     * to shards in turn, so every shard gets a similar share of every order.
+     *
+     * @param parameters is a grid of the experiment.
+     * @param group is an index of the point (group of points).
+     * @param trial is an index of the trial.
+     * @return true if this shard runs the trial.
+     */
+    static bool ownsTrial(const SweepParameters& parameters, std::size_t group, std::uint64_t trial)
+    {
+        if (parameters.shardCount <= 1)
+            return true;
+        std::uint64_t unit = group;
+        if (!parameters.adaptive) {
+            std::uint64_t block   = std::max<std::uint64_t>( parameters.shardTrialBlock, 1 );
+            std::uint64_t nBlocks = (std::max( parameters.nExperiments, 0 ) + block - 1) / block;
+            unit = group * nBlocks + trial / block;
+        }
+        return unit % parameters.shardCount == parameters.shardIndex;
+    }
+
+
+    /**
+     * Identifier of the noise stream of a single trial. All trials share
+     * the global seed and differ by stream.
+     *
+     * @param order is an index of the modulation order (below 2^16).
+     * @param snr is an index of the SNR value (below 2^16).
+     * @param trial is an index of the trial (below 2^32).
+     * @return stream of the trial.
+     */
+    static std::uint64_t trialStream(std::uint64_t order, std::uint64_t snr, std::uint64_t trial)
+    {
+        return order << 48 | snr << 32 | trial;
+    }
+
+
+
+private:
+
+
+    // Returns data itself, no copy is needed.
+    static const BitStream& asBitStream(const BitStream& inputData, BitStream&, bool)
+    {
+        return inputData;
+    }
+
+
+    // Copies data into a stream if it is needed.
+    template <typename Source>
+    static const BitStream& asBitStream(const Source& inputData, BitStream& copy, bool needed)
+    {
+        if (needed)
+            copy = inputData.toBitStream();
+        return copy;
+    }
+
+
+    // Copy of a point with its estimate.
+    static SweepPoint estimated(const SweepParameters& parameters, SweepPoint p)
+    {
+        estimate( parameters, p );
+        return p;
+    }
+
+
+    // Variance of importance sampling estimate is not trusted below this
+    // number of trials.
+    static constexpr std::uint64_t MIN_IMPORTANCE_TRIALS = 10;
+    // Round of the fixed mode with a listener stops taking groups at this
+    // number of items per worker.
+    static constexpr std::size_t   ROUND_ITEMS_PER_WORKER = 4;
+
+
+    struct alignas(64) WorkerState {
+        std::vector<GaussianChannel>    channels;
+        std::vector<qamDemodulator>     demodulators;
+        Instruments                     instruments;
+        FusedPipeline                   pipeline;
+        AsyncPipeline                   asyncPipeline;
+        ConvolutionalCode               code;
+        PulseShaper                     shaper;
+        // Staged chain reuses these from trial to trial.
+        BufferArena                     arena;
+        BitStream                       demodulated;
+        BitStream                       decoded;
+    };
+
+
+
+    ThreadPool                  pool_;
+    std::vector<WorkerState>    workers_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPENGINE_H
@@ -0,0 +1,189 @@
+// This class turns options of a sweep ("--key=value" pairs of
+// Instruments::parseArguments) into SweepParameters. The console app
+// parses its command line with it and SweepServer parses every job, so
+// both take the same options. Invalid options and combinations of modes
+// which are not supported throw std::invalid_argument with the reason.
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SweepEngine.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPOPTIONS_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPOPTIONS_H
+
+
+class SweepOptions {
+public:
+
+
+    /**
+     * Apply options to parameters. Parameters not named in options keep
+     * their values, so the caller sets defaults (grid, trials) first.
+     *
+     * @param options is a map from option name to its value.
+     * @param parameters is a sweep to change.
+     */
+    static void parse(const std::map<std::string, std::string>& options, SweepParameters& parameters)
+    {
+        auto has = [&options](const std::string& key) { return options.count( key ) != 0; };
+        auto get = [&options](const std::string& key) { return options.at( key ); };
+
+        if (has( "orders" )) {
+            parameters.modulationOrders.clear();
+            for (double i : parseList( get( "orders" ) ))
+                parameters.modulationOrders.push_back( int( i ) );
+        }
+        if (has( "snr" ))
+            parameters.SNR = parseList( get( "snr" ) );
+        if (parameters.modulationOrders.empty() || parameters.SNR.empty())
+            throw std::invalid_argument( "Grid must have at least one order and one SNR value" );
+        if (has( "trials" ))
+            parameters.nExperiments = std::stoi( get( "trials" ) );
+        if (has( "seed" ))
+            parameters.seed = std::stoull( get( "seed" ) );
+        if (has( "noise" ))
+            parameters.noiseSource = NoiseGenerator::parseSource( get( "noise" ) );
+        if (has( "fused" ))
+            parameters.fused = get( "fused" ) != "0";
+        if (has( "adaptive" ))
+            parameters.adaptive = get( "adaptive" ) != "0";
+        if (has( "target-errors" ))
+            parameters.targetErrors = std::stoull( get( "target-errors" ) );
+        if (has( "max-bits" ))
+            parameters.maxBits = std::stoull( get( "max-bits" ) );
+        if (has( "common-noise" )) {
+            parameters.commonNoise             = get( "common-noise" ) != "0";
+            parameters.commonNoiseAcrossOrders = get( "common-noise" ) == "orders";
+        }
+        if (has( "importance-sampling" ))
+            parameters.importanceSampling = get( "importance-sampling" ) != "0";
+        if (has( "fading" )) {
+            parameters.fading.model = FadingChannel::parseModel( get( "fading" ) );
+            if (has( "rician-k" ))
+                parameters.fading.ricianFactor = std::stod( get( "rician-k" ) );
+            if (has( "fading-block" ))
+                parameters.fading.blockSymbols = std::stoull( get( "fading-block" ) );
+            if (has( "equalizer" ))
+                parameters.fading.equalizer = FadingChannel::parseEqualizer( get( "equalizer" ) );
+            if (parameters.importanceSampling && parameters.fading.model != FadingParameters::NONE)
+                throw std::invalid_argument( "Importance sampling is not supported with fading" );
+        }
+        if (has( "code" )) {
+            parameters.code = ConvolutionalCode::parseDecision( get( "code" ) );
+            if (parameters.code != ConvolutionalCode::NONE
+                && (parameters.importanceSampling || parameters.fading.model != FadingParameters::NONE))
+                throw std::invalid_argument( "Code is not supported with importance sampling or fading" );
+        }
+        if (has( "pulse-shaping" ) && get( "pulse-shaping" ) != "0") {
+            parameters.pulseShaping.enabled = true;
+            if (has( "rolloff" ))
+                parameters.pulseShaping.rolloff = std::stod( get( "rolloff" ) );
+            if (has( "span" ))
+                parameters.pulseShaping.span = std::stoi( get( "span" ) );
+            if (has( "oversampling" ))
+                parameters.pulseShaping.oversampling = std::stoi( get( "oversampling" ) );
+            parameters.pulseShaping.direct = has( "filter" ) && get( "filter" ) == "direct";
+            if (parameters.importanceSampling || parameters.fading.model != FadingParameters::NONE)
+                throw std::invalid_argument( "Pulse shaping is not supported with importance sampling or fading" );
+        }
+        if (has( "pipelined" ))
+            parameters.pipelined = get( "pipelined" ) != "0";
+        if (has( "precision" )) {
+            parameters.precision = FusedPipeline::parsePrecision( get( "precision" ) == "check" ? "float" : get( "precision" ) );
+            if (parameters.precision == FusedPipeline::SINGLE
+                && (parameters.importanceSampling || parameters.fading.model != FadingParameters::NONE
+                    || parameters.code != ConvolutionalCode::NONE || parameters.pulseShaping.enabled))
+                throw std::invalid_argument( "Single precision is not supported with importance sampling, fading, code or pulse shaping" );
+        }
+        if (has( "adc" ))
+            parameters.adc.bits = std::stoi( get( "adc" ) );
+        if (has( "adc-full-scale" ))
+            parameters.adc.fullScale = std::stod( get( "adc-full-scale" ) );
+        if (has( "agc" ))
+            parameters.adc.agc = get( "agc" ) != "0";
+        if (parameters.adc.bits != 0 || has( "adc-curves" )) {
+            // Curves of BER against resolution take zero as no ADC.
+            std::vector<double> resolutions = has( "adc-curves" ) ? parseList( get( "adc-curves" ) ) : std::vector<double>();
+            resolutions.push_back( parameters.adc.bits );
+            for (double bits : resolutions)
+                if (bits != 0 && (bits < AdcQuantizer::MIN_BITS || bits > AdcQuantizer::MAX_BITS))
+                    throw std::invalid_argument( "ADC must have from 2 to 16 bits" );
+            if (parameters.importanceSampling || parameters.fading.model != FadingParameters::NONE
+                || parameters.code != ConvolutionalCode::NONE || parameters.pulseShaping.enabled
+                || parameters.precision == FusedPipeline::SINGLE || parameters.commonNoise)
+                throw std::invalid_argument( "ADC is not supported with importance sampling, fading, code, pulse shaping, "
+                                             "single precision or common noise" );
+        }
+        if (parameters.pipelined
+            && (parameters.importanceSampling || parameters.fading.model != FadingParameters::NONE
+                || parameters.code != ConvolutionalCode::NONE || parameters.pulseShaping.enabled
+                || parameters.precision == FusedPipeline::SINGLE || parameters.commonNoise
+                || parameters.adc.bits != 0 || has( "adc-curves" )))
+            throw std::invalid_argument( "Pipelined mode is not supported with importance sampling, fading, code, "
+                                         "pulse shaping, single precision, common noise or ADC" );
+        if (has( "shard" )) {
+            std::string shard = get( "shard" );
+            parameters.shardIndex = std::stoul( shard );
+            parameters.shardCount = std::stoul( shard.substr( shard.find( '/' ) + 1 ) );
+            if (parameters.shardCount == 0 || parameters.shardIndex >= parameters.shardCount)
+                throw std::invalid_argument( "Shard must be I/N with I < N" );
+        }
+        if (has( "hybrid" ) && get( "hybrid" ) != "0")
+            parseSimulatedPoints( has( "simulate" ) ? get( "simulate" ) : "", parameters );
+    }
+
+
+    // Parses comma-separated numbers.
+    static std::vector<double> parseList(const std::string& text)
+    {
+        std::vector<double> values;
+        std::stringstream   list( text );
+        for (std::string value; std::getline( list, value, ',' ); )
+            values.push_back( std::stod( value ) );
+        return values;
+    }
+
+
+
+private:
+
+
+    // Marks points of the hybrid mode given as ORDER@SNR,... (or "all")
+    // to simulate. Without theory all points are simulated.
+    static void parseSimulatedPoints(const std::string& simulate, SweepParameters& parameters)
+    {
+        const std::vector<int>&    modulationOrders = parameters.modulationOrders;
+        const std::vector<double>& SNR              = parameters.SNR;
+        if (!SweepEngine::hasTheory( parameters )) {
+            std::cerr << "Theory does not apply to code, fading, pulse shaping or ADC, all points are simulated" << std::endl;
+            return;
+        }
+        parameters.simulated.assign( modulationOrders.size() * SNR.size(), simulate == "all" );
+        std::stringstream list( simulate == "all" ? "" : simulate );
+        for (std::string point; std::getline( list, point, ',' ); ) {
+            std::size_t at = point.find( '@' );
+            std::size_t k  = modulationOrders.size();
+            std::size_t i  = SNR.size();
+            if (at != std::string::npos) {
+                k = std::find( modulationOrders.begin(), modulationOrders.end(), std::stoi( point ) ) - modulationOrders.begin();
+                i = std::find( SNR.begin(), SNR.end(), std::stod( point.substr( at + 1 ) ) ) - SNR.begin();
+            }
+            if (k == modulationOrders.size() || i == SNR.size())
+                throw std::invalid_argument( "Point " + point + " is not in the grid, it must be ORDER@SNR" );
+            parameters.simulated[ k * SNR.size() + i ] = true;
+        }
+    }
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPOPTIONS_H
@@ -0,0 +1,355 @@
+// This class runs sweeps for clients on a Unix domain socket, so a front
+// end (GaussianChannelClient, the MATLAB app) does not build and start
+// the console app for every sweep. One engine lives as long as the
+// server: its thread pool, worker buffers, constellation tables and the
+// payload stay warm from job to job. Connections are served one after
+// another. A client sends one line with the options of a sweep, as on
+// the command line of the console app (see SweepOptions), separated by
+// spaces, within LINE_SECONDS of connecting or the connection is dropped;
+// the server default grid and options are those of its own command line. The reply is a line per point as soon as the point is
+// finished:
+//
+//     point ORDER SNR BER LOWER UPPER ERRORS BITS TRIALS
+//
+// and then "done SECONDS" or "error MESSAGE". In hybrid mode points which
+// are not simulated come first, before any trial is run, with BER from
+// TheoreticalBER (for the symbol histogram of the payload) and zero bits.
+// Line "--shutdown" stops the server. Payload is Data.txt (text) by
+// default or --input=PATH|prbs|random with --payload-bits=N, of the job or
+// else of the server command line; it is read again only when the input
+// or the file changes.
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "BitStream.h"
+#include "PayloadSource.h"
+#include "SweepEngine.h"
+#include "SweepOptions.h"
+#include "TheoreticalBER.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPSERVER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPSERVER_H
+
+
+class SweepServer {
+public:
+
+
+    // Longest job line in bytes.
+    static constexpr std::size_t MAX_LINE       = 65536;
+    // Time a client has to send its job line.
+    static constexpr int         LINE_SECONDS   = 10;
+
+
+    /**
+     * Create server, the socket is opened by run.
+     *
+     * @param pathToSocket is a path of the socket file.
+     * @param nThreads is a number of workers of the engine (zero is one
+     * per hardware thread).
+     * @param defaults is a sweep which options of every job change.
+     * @param payloadOptions is options of the server command line, its
+     * --input and --payload-bits are the payload of jobs without them.
+     */
+    SweepServer(std::string pathToSocket, unsigned nThreads, SweepParameters defaults,
+                const std::map<std::string, std::string>& payloadOptions = {})
+        : pathToSocket_( std::move( pathToSocket ) ),
+          defaults_( std::move( defaults ) ),
+          engine_( nThreads )
+    {
+        defaults_.simulated.clear();
+        for (const char* key : PAYLOAD_OPTIONS)
+            if (payloadOptions.count( key ))
+                payloadOptions_[ key ] = payloadOptions.at( key );
+    }
+
+
+    /**
+     * Serve clients until a shutdown job. A stale socket file of a server
+     * which did not stop is replaced.
+     *
+     * @return 0 after shutdown, 1 if the socket cannot be opened.
+     */
+    int run()
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (pathToSocket_.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path " << pathToSocket_ << " is too long" << std::endl;
+            return 1;
+        }
+        pathToSocket_.copy( address.sun_path, pathToSocket_.size() );
+        struct stat status;
+        if (lstat( pathToSocket_.c_str(), &status ) == 0) {
+            if (!S_ISSOCK( status.st_mode )) {
+                std::cerr << pathToSocket_ << " exists and is not a socket" << std::endl;
+                return 1;
+            }
+            unlink( pathToSocket_.c_str() );
+        }
+        int listening = socket( AF_UNIX, SOCK_STREAM, 0 );
+        if (listening < 0 || bind( listening, reinterpret_cast<sockaddr*>( &address ), sizeof(address) ) != 0
+            || listen( listening, 8 ) != 0) {
+            std::cerr << "Error while opening socket " << pathToSocket_ << std::endl;
+            if (listening >= 0)
+                close( listening );
+            return 1;
+        }
+        std::cerr << "Serving sweeps on " << pathToSocket_ << " with " << engine_.getNumberOfThreads() << " threads" << std::endl;
+
+        bool running = true;
+        while (running) {
+            int connection = accept( listening, nullptr, nullptr );
+            if (connection < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                std::cerr << "Error while accepting connection" << std::endl;
+                break;
+            }
+            std::optional<std::string> line = readLine( connection );
+            if (line)
+                running = serve( *line, connection );
+            close( connection );
+        }
+        close( listening );
+        unlink( pathToSocket_.c_str() );
+        return 0;
+    }
+
+
+
+private:
+
+
+    // Options which choose the payload.
+    static constexpr const char* PAYLOAD_OPTIONS[] = { "input", "payload-bits" };
+
+
+    // Client closed its connection during a job.
+    struct Disconnected : std::runtime_error {
+        Disconnected() : std::runtime_error( "Client disconnected" ) {}
+    };
+
+
+    /**
+     * Run one job and reply to it.
+     *
+     * @param line is a job line.
+     * @param connection is a socket of the client.
+     * @return false if the job stops the server.
+     */
+    bool serve(const std::string& line, int connection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::map<std::string, std::string> options = parseLine( line );
+        if (options.count( "shutdown" )) {
+            send( connection, "done 0\n" );
+            return false;
+        }
+        try {
+            SweepParameters parameters = defaults_;
+            SweepOptions::parse( options, parameters );
+            auto listener = [connection](const SweepPoint& p) {
+                if (!send( connection, pointLine( p ) ))
+                    throw Disconnected();
+            };
+            std::map<std::string, std::string> payloadOptions = payloadOptions_;
+            for (const char* key : PAYLOAD_OPTIONS)
+                if (options.count( key ))
+                    payloadOptions[ key ] = options.at( key );
+            bool isSource = loadPayload( payloadOptions, parameters.seed );
+            // Points which are not simulated take theory at once.
+            std::size_t                         nSNR = parameters.SNR.size();
+            std::map<int, std::vector<double> > probabilities;
+            for (std::size_t point = 0; point < parameters.simulated.size(); point++) {
+                if (parameters.simulated[ point ])
+                    continue;
+                SweepPoint p;
+                p.modulationOrder = parameters.modulationOrders[ point / nSNR ];
+                p.SNR             = parameters.SNR[ point % nSNR ];
+                if (!probabilities.count( p.modulationOrder ))
+                    probabilities[ p.modulationOrder ] = isSource
+                        ? TheoreticalBER::codeProbabilities( payload_->source, p.modulationOrder )
+                        : TheoreticalBER::codeProbabilities( payload_->text, p.modulationOrder );
+                p.BER = p.lower = p.upper = TheoreticalBER::bitErrorRate( p.modulationOrder, p.SNR,
+                                                                          probabilities[ p.modulationOrder ] );
+                listener( p );
+            }
+            if (isSource)
+                engine_.run( parameters, payload_->source, nullptr, listener );
+            else
+                engine_.run( parameters, payload_->text, nullptr, listener );
+            std::ostringstream done;
+            done << "done " << std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() << '\n';
+            send( connection, done.str() );
+        }
+        catch (const Disconnected& exception) {
+            std::cerr << exception.what() << ", job is cancelled" << std::endl;
+        }
+        catch (const std::exception& exception) {
+            send( connection, std::string( "error " ) + exception.what() + '\n' );
+        }
+        return true;
+    }
+
+
+    /**
+     * Make the payload of a job current, reading it only if the input
+     * differs from the last job or its file was changed.
+     *
+     * @param options is payload options of the job (PAYLOAD_OPTIONS).
+     * @param seed is a seed of the job (random payload depends on it).
+     * @return true if the payload is a PayloadSource, false if it is text.
+     */
+    bool loadPayload(const std::map<std::string, std::string>& options, std::uint64_t seed)
+    {
+        bool          isText       = !options.count( "input" );
+        std::string   input        = isText ? "./Data.txt" : options.at( "input" );
+        std::uint64_t nPayloadBits = options.count( "payload-bits" ) ? std::stoull( options.at( "payload-bits" ) ) : 1000000;
+        std::ostringstream key;
+        key << isText << ' ' << input;
+        if (input == "prbs" || input == "random")
+            key << ' ' << nPayloadBits << ' ' << (input == "random" ? seed : 0);
+        else {
+            std::error_code error;
+            key << ' ' << std::filesystem::last_write_time( input, error ).time_since_epoch().count();
+        }
+        if (payload_ && payload_->key == key.str())
+            return !isText;
+
+        payload_.reset();
+        if (isText) {
+            Instruments InstrumentsObj;
+            BitStream text = InstrumentsObj.stringToBinary( InstrumentsObj.readFile( input ) );
+            payload_.emplace( key.str(), std::move( text ), PayloadSource::prbs( 0 ) );
+        }
+        else {
+            PayloadSource source = input == "prbs"   ? PayloadSource::prbs( nPayloadBits )
+                                 : input == "random" ? PayloadSource::random( nPayloadBits, seed )
+                                                     : PayloadSource::fromFile( input );
+            payload_.emplace( key.str(), BitStream(), std::move( source ) );
+        }
+        if (isText ? payload_->text.empty() : payload_->source.empty()) {
+            payload_.reset();
+            throw std::invalid_argument( "Input " + input + " is empty or cannot be read" );
+        }
+        return !isText;
+    }
+
+
+    // Splits a job line into options like Instruments::parseArguments.
+    static std::map<std::string, std::string> parseLine(const std::string& line)
+    {
+        std::vector<std::string> arguments = { "" };
+        std::istringstream       words( line );
+        for (std::string word; words >> word; )
+            arguments.push_back( word );
+        std::vector<char*> argv;
+        for (std::string& i : arguments)
+            argv.push_back( i.data() );
+        Instruments InstrumentsObj;
+        return InstrumentsObj.parseArguments( int( argv.size() ), argv.data() );
+    }
+
+
+    // Reads bytes up to a new line, nothing if the line is too long, does
+    // not come within LINE_SECONDS or the client closed the connection
+    // before it. Connections are served one by one, so a silent client
+    // would hold back all others without the deadline.
+    static std::optional<std::string> readLine(int connection)
+    {
+        auto        deadline = std::chrono::steady_clock::now() + std::chrono::seconds( LINE_SECONDS );
+        std::string line;
+        char        c;
+        while (line.size() < MAX_LINE) {
+            auto   left    = std::chrono::ceil<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() );
+            pollfd waiting = { connection, POLLIN, 0 };
+            int    ready   = left.count() > 0 ? poll( &waiting, 1, int( left.count() ) ) : 0;
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready == 0) {
+                std::cerr << "Client sent no job line in " << LINE_SECONDS << " seconds, connection is dropped" << std::endl;
+                return std::nullopt;
+            }
+            if (ready < 0)
+                return std::nullopt;
+            ssize_t n = recv( connection, &c, 1, 0 );
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return std::nullopt;
+            if (c == '\n')
+                return line;
+            line += c;
+        }
+        return std::nullopt;
+    }
+
+
+    // Writes all of text, false if the client is gone.
+    static bool send(int connection, const std::string& text)
+    {
+        for (std::size_t sent = 0; sent < text.size(); ) {
+            ssize_t n = ::send( connection, text.data() + sent, text.size() - sent, MSG_NOSIGNAL );
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+
+
+    static std::string pointLine(const SweepPoint& p)
+    {
+        std::ostringstream line;
+        line.precision( 12 );
+        line << "point " << p.modulationOrder << ' ' << p.SNR << ' ' << p.BER << ' ' << p.lower << ' ' << p.upper
+             << ' ' << p.errors << ' ' << p.bits << ' ' << p.trials << '\n';
+        return line.str();
+    }
+
+
+
+    // Payload of the last job: text (BitStream) or PayloadSource.
+    struct Payload {
+        std::string     key;
+        BitStream       text;
+        PayloadSource   source;
+    };
+
+
+
+    std::string                         pathToSocket_;
+    SweepParameters                     defaults_;
+    std::map<std::string, std::string>  payloadOptions_;
+    SweepEngine                         engine_;
+    std::optional<Payload>              payload_;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_SWEEPSERVER_H
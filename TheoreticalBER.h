@@ -0,0 +1,151 @@
+// This class calculates BER of the uncoded AWGN chain in closed form. SNR
+// is normalized as in GaussianChannel (Eb = (M-1)/(3 log2 M) of points on
+// the odd integer grid) and decisions are made per axis as in
+// qamDemodulator, so the result is the expectation of what the Monte
+// Carlo sweep measures, not an approximation, for the symbol statistics
+// it is given: equally likely symbols by default, or the histogram of the
+// payload (text is far from uniform). Code of a point is the Grey code of
+// its index row * N + column (see ConstellationTable), so bit errors
+// depend only on XOR of sent and decided rows and XOR of sent and decided
+// columns, and the sum over all M x M pairs of points reduces to sums
+// over N x N pairs of positions of an axis.
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ConstellationTable.h"
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THEORETICALBER_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THEORETICALBER_H
+
+
+class TheoreticalBER {
+public:
+
+
+    /**
+     * Calculate BER of the uncoded chain without fading.
+     *
+     * @param modulationOrder is a supported modulation order.
+     * @param SNR is a signal-to-noise ratio value (Eb/N0 as in GaussianChannel) in dB.
+     * @param codeProbabilities is a probability of every code (transmitted
+     * bits of a symbol, see codeProbabilities), empty for equally likely codes.
+     * @return probability of a bit error.
+     */
+    static double bitErrorRate(int modulationOrder, double SNR, std::span<const double> codeProbabilities = {})
+    {
+        const ConstellationTable& table = ConstellationTable::forOrder( modulationOrder );
+        int     bitsPerSymbol   = table.getBitsPerSymbol();
+        int     nReImValues     = table.getNumberOfAxisValues();
+        double  Eb              = (modulationOrder - 1) / (3.0 * bitsPerSymbol);
+        double  sigma           = std::sqrt( Eb / std::pow( 10, SNR / 10 ) / 2 );
+
+        // Row bits are the Grey code of row XOR, column bits are the Grey
+        // code of column XOR with the top bit flipped by the LSB of row XOR.
+        // For every sent position of an axis: expected errors of its bits
+        // (as a row, as a column with the top bit kept or flipped) and
+        // probability of an odd XOR.
+        int                 topBit = nReImValues / 2;
+        std::vector<double> rowErrors( nReImValues );
+        std::vector<double> oddRows( nReImValues );
+        std::vector<double> columnErrors[2] = { std::vector<double>( nReImValues ), std::vector<double>( nReImValues ) };
+        for (int sent = 0; sent < nReImValues; sent++)
+            for (int decided = 0; decided < nReImValues; decided++) {
+                double   probability = decisionProbability( nReImValues, sent, decided, sigma );
+                unsigned grey        = (sent ^ decided) ^ ((sent ^ decided) >> 1);
+                rowErrors[ sent ]       += probability * std::popcount( grey );
+                oddRows[ sent ]         += probability * ((sent ^ decided) & 1);
+                columnErrors[0][ sent ] += probability * std::popcount( grey );
+                columnErrors[1][ sent ] += probability * std::popcount( grey ^ topBit );
+            }
+
+        // Rows and columns of sent points are independent if codes are
+        // equally likely, then means over positions of an axis are enough.
+        double errors = 0;
+        if (codeProbabilities.empty()) {
+            double meanRowErrors = 0;
+            double meanOddRows   = 0;
+            double meanColumnErrors[2] = {};
+            for (int i = 0; i < nReImValues; i++) {
+                meanRowErrors       += rowErrors[i] / nReImValues;
+                meanOddRows         += oddRows[i] / nReImValues;
+                meanColumnErrors[0] += columnErrors[0][i] / nReImValues;
+                meanColumnErrors[1] += columnErrors[1][i] / nReImValues;
+            }
+            errors = meanRowErrors + (1 - meanOddRows) * meanColumnErrors[0] + meanOddRows * meanColumnErrors[1];
+        }
+        else {
+            std::span<const int> indicesOfCodes = table.getIndicesOfCodes();
+            for (int code = 0; code < modulationOrder; code++) {
+                int row    = indicesOfCodes[ code ] / nReImValues;
+                int column = indicesOfCodes[ code ] % nReImValues;
+                errors += codeProbabilities[ code ] * (rowErrors[ row ] + (1 - oddRows[ row ]) * columnErrors[0][ column ]
+                                                       + oddRows[ row ] * columnErrors[1][ column ]);
+            }
+        }
+        return errors / bitsPerSymbol;
+    }
+
+
+    /**
+     * Histogram of codes of symbols of a payload, read as qamModulator
+     * reads them. The last symbol, if it is not whole, is left out.
+     *
+     * @param inputData is a payload: BitStream or PayloadSource.
+     * @param modulationOrder is a supported modulation order.
+     * @return probability of every code.
+     */
+    template <typename Source>
+    static std::vector<double> codeProbabilities(const Source& inputData, int modulationOrder)
+    {
+        int                 bitsPerSymbol = ConstellationTable::forOrder( modulationOrder ).getBitsPerSymbol();
+        std::uint64_t       nSymbols      = inputData.size() / bitsPerSymbol;
+        std::vector<double> probabilities( modulationOrder );
+        for (std::uint64_t i = 0; i < nSymbols; i++)
+            probabilities[ inputData.read( i * bitsPerSymbol, bitsPerSymbol ) ] += 1;
+        for (double& i : probabilities)
+            i = nSymbols ? i / nSymbols : 1.0 / modulationOrder;
+        return probabilities;
+    }
+
+
+
+private:
+
+
+    // Upper tail of the standard normal distribution.
+    static double Q(double x)
+    {
+        return 0.5 * std::erfc( x / std::sqrt( 2.0 ) );
+    }
+
+
+    /**
+     * Probability to decide position "decided" of an axis when "sent" was
+     * sent. Position i has value N-1-2i and is decided between N-2-2i and
+     * N-2i, the outer positions up to infinity. Tails are subtracted on
+     * the side of zero where the interval is, so small probabilities keep
+     * their relative precision.
+     */
+    static double decisionProbability(int nReImValues, int sent, int decided, double sigma)
+    {
+        double value = nReImValues - 1 - 2 * sent;
+        // Interval of noise (in units of sigma) which gives the decision.
+        double lower = decided == nReImValues - 1 ? -INFINITY : (nReImValues - 2 - 2 * decided - value) / sigma;
+        double upper = decided == 0               ?  INFINITY : (nReImValues - 2 * decided - value) / sigma;
+        if (lower >= 0)
+            return Q( lower ) - Q( upper );
+        if (upper <= 0)
+            return Q( -upper ) - Q( -lower );
+        return 1 - Q( -lower ) - Q( upper );
+    }
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THEORETICALBER_H
@@ -0,0 +1,241 @@
+// This class is a small work-stealing thread pool. Every worker owns
+// its own task queue: it takes work from the back of its own queue and,
+// when the queue runs dry, steals from the front of the other queues.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THREADPOOL_H
+#define GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THREADPOOL_H
+
+
+class ThreadPool {
+public:
+
+
+    /**
+     * Start worker threads.
+     *
+     * @param nThreads is a number of workers. Zero means one worker
+     * per hardware thread.
+     */
+    explicit ThreadPool(unsigned nThreads = 0)
+    {
+        if (nThreads == 0)
+            nThreads = std::thread::hardware_concurrency();
+        if (nThreads == 0)
+            nThreads = 1;
+        for (unsigned i = 0; i < nThreads; i++)
+            queues_.push_back( std::make_unique<WorkerQueue>() );
+        for (unsigned i = 0; i < nThreads; i++)
+            threads_.emplace_back( [this, i] { workerLoop( i ); } );
+    }
+
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( sleepMutex_ );
+            stop_ = true;
+        }
+        wakeUp_.notify_all();
+        for (std::thread& i : threads_)
+            i.join();
+    }
+
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+
+    // Returns number of workers.
+    unsigned size() const
+    {
+        return threads_.size();
+    }
+
+
+    /**
+     * Run body(item, workerId) for every item in [0, nItems) and wait
+     * until all of them are done. Items are grouped into chunks of
+     * grainSize which are dealt round-robin over the worker queues.
+     * The first exception thrown by body is rethrown here.
+     * Must not be called from inside a worker.
+     *
+     * @param nItems is a number of work items.
+     * @param grainSize is a number of consecutive items in one task.
+     * @param body is a function to call for every item.
+     */
+    void parallelFor(std::size_t nItems, std::size_t grainSize,
+                     const std::function<void(std::size_t, unsigned)>& body)
+    {
+        if (nItems == 0)
+            return;
+        if (grainSize == 0)
+            grainSize = 1;
+        std::size_t nChunks = (nItems + grainSize - 1) / grainSize;
+
+        Job job;
+        job.body      = &body;
+        job.nItems    = nItems;
+        job.grainSize = grainSize;
+        job.remaining = nChunks;
+
+        {
+            std::lock_guard<std::mutex> lock( sleepMutex_ );
+            queued_ += nChunks;
+        }
+        for (std::size_t c = 0; c < nChunks; c++) {
+            WorkerQueue& queue = *queues_[ c % queues_.size() ];
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            queue.tasks.push_back( Task{ &job, c } );
+        }
+        wakeUp_.notify_all();
+
+        std::unique_lock<std::mutex> lock( job.doneMutex );
+        job.done.wait( lock, [&] { return job.remaining.load() == 0; } );
+        if (job.error)
+            std::rethrow_exception( job.error );
+    }
+
+
+
+private:
+
+
+    // One call of parallelFor, lives on the stack of the caller.
+    struct Job {
+        const std::function<void(std::size_t, unsigned)>*  body;
+        std::size_t                                         nItems;
+        std::size_t                                         grainSize;
+        std::atomic<std::size_t>                            remaining;
+        std::mutex                                          doneMutex;
+        std::condition_variable                             done;
+        std::exception_ptr                                  error;
+        std::mutex                                          errorMutex;
+    };
+
+
+    // Chunk of a job. Tasks are plain values, so queues do not allocate
+    // once their vectors are large enough.
+    struct Task {
+        Job*        job   = nullptr;
+        std::size_t chunk = 0;
+    };
+
+
+    // Tasks of a worker: the owner takes from the back, thieves take from
+    // the front.
+    struct alignas(64) WorkerQueue {
+        std::mutex          mutex;
+        std::vector<Task>   tasks;
+        std::size_t         front = 0;
+
+        bool empty() const
+        {
+            return front == tasks.size();
+        }
+
+        // Starts the vector over once every task is taken.
+        void compact()
+        {
+            if (empty()) {
+                tasks.clear();
+                front = 0;
+            }
+        }
+    };
+
+
+    static void run(const Task& task, unsigned workerId)
+    {
+        Job&        job   = *task.job;
+        std::size_t begin = task.chunk * job.grainSize;
+        std::size_t end   = std::min( job.nItems, begin + job.grainSize );
+        try {
+            for (std::size_t i = begin; i < end; i++)
+                (*job.body)( i, workerId );
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock( job.errorMutex );
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+        // Under the mutex: the caller may destroy the job as soon as it
+        // sees no remaining chunks.
+        std::lock_guard<std::mutex> lock( job.doneMutex );
+        if (job.remaining.fetch_sub( 1 ) == 1)
+            job.done.notify_all();
+    }
+
+
+    // Takes the newest task from own queue.
+    bool popLocal(unsigned workerId, Task& task)
+    {
+        WorkerQueue& queue = *queues_[ workerId ];
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        if (queue.empty())
+            return false;
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        queue.compact();
+        queued_--;
+        return true;
+    }
+
+
+    // Takes the oldest task from one of the other queues.
+    bool steal(unsigned workerId, Task& task)
+    {
+        for (std::size_t i = 1; i < queues_.size(); i++) {
+            WorkerQueue& queue = *queues_[ (workerId + i) % queues_.size() ];
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            if (queue.empty())
+                continue;
+            task = queue.tasks[ queue.front++ ];
+            queue.compact();
+            queued_--;
+            return true;
+        }
+        return false;
+    }
+
+
+    void workerLoop(unsigned workerId)
+    {
+        while (true) {
+            Task task;
+            if (popLocal( workerId, task ) || steal( workerId, task )) {
+                run( task, workerId );
+                continue;
+            }
+            std::unique_lock<std::mutex> lock( sleepMutex_ );
+            wakeUp_.wait( lock, [this] { return stop_ || queued_.load() > 0; } );
+            if (stop_ && queued_.load() == 0)
+                return;
+        }
+    }
+
+
+
+    std::vector<std::unique_ptr<WorkerQueue> >  queues_;
+    std::vector<std::thread>                    threads_;
+    std::mutex                                  sleepMutex_;
+    std::condition_variable                     wakeUp_;
+    std::atomic<long>                           queued_ = 0;
+    bool                                        stop_ = false;
+
+
+
+};
+
+
+#endif //GAUSSIANCHANNELDIGITALMODELCONSOLEAPP_THREADPOOL_H